@@ -43,6 +43,30 @@
   */
 #define crc_flag_mask 0x10000
 
+/** @defgroup crc_stream 
+  * @brief  Streaming CRC-16/X-25 and CRC-32, software, checked on known
+  *         vectors by Tools/HostSim/crc_test.
+  *         Define CRC_STREAM_HW to feed CRC-16 through the CRC unit instead.
+  *         Not verified on the chip: CRC16_HW_XOROUT (what CRC_RESULT reads
+  *         back on top of the CRC register) and seeding the register by a
+  *         CRC_RESULT write are assumptions. Compare "123456789" with 0x906E
+  *         on the board before turning it on.
+  * @{
+  */
+#ifndef CRC16_HW_XOROUT
+#define CRC16_HW_XOROUT   0xFFFF
+#endif
+
+typedef struct
+{
+  uint16_t crc;       /*!< CRC register, not yet final */
+} CRC_Ctx16TypeDef;
+
+typedef struct
+{
+  uint32_t crc;       /*!< CRC register, not yet final */
+} CRC_Ctx32TypeDef;
+
 /* Exported functions --------------------------------------------------------*/  
 void CRC_init(void);
 uint16_t CRC_CalcCRC8(uint8_t Data);
@@ -60,6 +84,13 @@ ErrorStatus CRC_CheckCRC32(uint32_t Data);
 uint16_t CRC_MultiCalcCRC32(uint32_t *buffer,uint32_t count);
 ErrorStatus CRC_MultiCheckCRC32(uint32_t *buffer,uint32_t count);
 
+void CRC_StreamInit16(CRC_Ctx16TypeDef *ctx);
+void CRC_StreamUpdate16(CRC_Ctx16TypeDef *ctx, const uint8_t *buffer, uint32_t count);
+uint16_t CRC_StreamFinal16(const CRC_Ctx16TypeDef *ctx);
+void CRC_StreamInit32(CRC_Ctx32TypeDef *ctx);
+void CRC_StreamUpdate32(CRC_Ctx32TypeDef *ctx, const uint8_t *buffer, uint32_t count);
+uint32_t CRC_StreamFinal32(const CRC_Ctx32TypeDef *ctx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,7 +39,8 @@
 typedef enum
 { 
   FLASH_BUSY = 1,
-  FLASH_COMPLETE
+  FLASH_COMPLETE,
+  FLASH_ERROR_PROGRAM     /*!< a word does not read back as programmed */
 }FLASH_Status;
 
 /* Exported constants --------------------------------------------------------*/
@@ -57,6 +58,11 @@ typedef enum
 #define    FLASH_CHIPEARSE       (uint32_t)0x00000003
 #define    FLASH_OPERATION_MASK  (uint32_t)0xFFFFFF00      
 
+/*FLASH_ProgramBuffer mode*/
+#define    FLASH_BUFFER_WRITE       (uint32_t)0x00000000  /*!< program every word */
+#define    FLASH_BUFFER_SKIP_SAME   (uint32_t)0x00000001  /*!< read first, skip words already holding the data */
+#define IS_FLASH_BUFFER_MODE(MODE) (((MODE) == FLASH_BUFFER_WRITE) || ((MODE) == FLASH_BUFFER_SKIP_SAME))
+
 
 
 #define IS_FLASH_ADDRESS(ADDRESS) (((ADDRESS) >= 0x00000000) && ((ADDRESS) <= 0xFFFFFFFF))
@@ -176,6 +182,7 @@ FLASH_Status FLASH_EraseAllSectors(void);
 FLASH_Status FLASH_ProgramWord(uint32_t Address, uint32_t Data);
 FLASH_Status FLASH_ProgramHalfWord(uint32_t Address, uint16_t Data);
 FLASH_Status FLASH_ProgramByte(uint32_t Address, uint8_t Data);
+FLASH_Status FLASH_ProgramBuffer(uint32_t Address, const uint8_t *Data, uint32_t Length, uint32_t Mode);
 void FLASH_OB_WRPConfig(uint32_t OB_Sector, uint32_t OB_WRP, FunctionalState NewState);
 void FLASH_OB_UserConfig(FunctionalState NewState);
 void FLASH_OB_ISPConfig(FunctionalState NewState);
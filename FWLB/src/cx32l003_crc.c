@@ -320,6 +320,149 @@ ErrorStatus CRC_MultiCheckCRC32(uint32_t *buffer,uint32_t count)
   return ERROR;	
 }
 
+/* Streaming CRC ------------------------------------------------------------*/
+/* Volatile views of the CRC registers: the CRC_RESULT/CRC_DATA_x macros are
+   not volatile, a loop of writes through them may be merged */
+#define CRC_REG_RESULT    (*(__IO uint32_t *)(CRC_BASE+0x04))
+#define CRC_REG_DATA_8    (*(__IO uint8_t  *)(CRC_BASE+0x80))
+#define CRC_REG_DATA_32   (*(__IO uint32_t *)(CRC_BASE+0x80))
+
+/* polynomials of the nibble tables */
+#define CRC16_POLY_REV    0x8408          /* x^16+x^12+x^5+1, reflected */
+#define CRC32_POLY_REV    0xEDB88320UL    /* IEEE 802.3, reflected */
+
+/* CRC-16/X-25 nibble table, 32 bytes of flash */
+static const uint16_t crc16_nibble[16] =
+{
+	0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+	0x8408, 0x9489, 0xA50A, 0xB58B, 0xC60C, 0xD68D, 0xE70E, 0xF78F
+};
+
+/* CRC-32 nibble table, 64 bytes of flash instead of 1KB */
+static const uint32_t crc32_nibble[16] =
+{
+	0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL,
+	0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+	0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL,
+	0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL
+};
+
+/**
+  * @brief  Starts a CRC-16/X-25 computation.
+  * @param  ctx: context, one per running computation
+  * @retval None
+  */
+void CRC_StreamInit16(CRC_Ctx16TypeDef *ctx)
+{
+	ctx->crc = 0xFFFF;
+}
+
+/**
+  * @brief  Adds a byte span to a CRC-16/X-25 computation.
+  * @note   Software, nibble table. CRC_STREAM_HW: loads ctx into the CRC
+  *         unit and saves it back, so computations can be interleaved, not
+  *         from interrupts while another one runs. The word aligned middle
+  *         of the span is fed 32 bit at a time, the unit takes the low byte
+  *         first. The CRC clock (RCC_AHBPeriph_CRCEN) must be on.
+  * @param  ctx: context from CRC_StreamInit16
+  * @param  buffer: bytes, any alignment
+  * @param  count: number of bytes, may be 0
+  * @retval None
+  */
+void CRC_StreamUpdate16(CRC_Ctx16TypeDef *ctx, const uint8_t *buffer, uint32_t count)
+{
+#ifdef CRC_STREAM_HW
+	/* the unit reads back register^CRC16_HW_XOROUT, writes set the register */
+	CRC_REG_RESULT = ctx->crc;
+
+	/* bytes up to the first word boundary */
+	while(count && ((uint32_t)buffer & 3))
+	{
+		CRC_REG_DATA_8 = *buffer++;
+		count--;
+	}
+	/* whole words */
+	while(count >= 4)
+	{
+		CRC_REG_DATA_32 = *(const uint32_t *)buffer;
+		buffer += 4;
+		count -= 4;
+	}
+	/* tail */
+	while(count--)
+	{
+		CRC_REG_DATA_8 = *buffer++;
+	}
+
+	ctx->crc = (uint16_t)(CRC_REG_RESULT ^ CRC16_HW_XOROUT);
+#else
+	uint16_t crc = ctx->crc;
+
+	while(count--)
+	{
+		crc ^= *buffer++;
+		crc = (crc >> 4) ^ crc16_nibble[crc & 0x0F];
+		crc = (crc >> 4) ^ crc16_nibble[crc & 0x0F];
+	}
+	ctx->crc = crc;
+#endif
+}
+
+/**
+  * @brief  Ends a CRC-16/X-25 computation.
+  * @note   "123456789" gives 0x906E
+  * @param  ctx: context, may be updated further after this
+  * @retval 16-bit CRC
+  */
+uint16_t CRC_StreamFinal16(const CRC_Ctx16TypeDef *ctx)
+{
+	return (uint16_t)(ctx->crc ^ 0xFFFF);
+}
+
+/**
+  * @brief  Starts a CRC-32 (IEEE 802.3) computation.
+  * @param  ctx: context, one per running computation
+  * @retval None
+  */
+void CRC_StreamInit32(CRC_Ctx32TypeDef *ctx)
+{
+	ctx->crc = 0xFFFFFFFFUL;
+}
+
+/**
+  * @brief  Adds a byte span to a CRC-32 computation.
+  * @note   Software, nibble table: the CRC unit is 16 bit only.
+  *         Same result as zlib crc32().
+  * @param  ctx: context from CRC_StreamInit32
+  * @param  buffer: bytes, any alignment
+  * @param  count: number of bytes, may be 0
+  * @retval None
+  */
+void CRC_StreamUpdate32(CRC_Ctx32TypeDef *ctx, const uint8_t *buffer, uint32_t count)
+{
+	uint32_t crc = ctx->crc;
+
+	while(count--)
+	{
+		crc ^= *buffer++;
+		crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+		crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+	}
+	ctx->crc = crc;
+}
+
+/**
+  * @brief  Ends a CRC-32 computation.
+  * @note   "123456789" gives 0xCBF43926
+  * @param  ctx: context, may be updated further after this
+  * @retval 32-bit CRC
+  */
+uint32_t CRC_StreamFinal32(const CRC_Ctx32TypeDef *ctx)
+{
+	return ctx->crc ^ 0xFFFFFFFFUL;
+}
+
+
 
 
 
@@ -22,6 +22,8 @@
           functions to erase and program the main memory:
         (++) Erase function: Erase sector, erase all sectors
         (++) Program functions: byte, half word, word and double word
+        (++) Buffer program function: many words with one unlock, can skip
+             the words that already hold the data
     
 
     
@@ -79,7 +81,7 @@ FLASH_Status FLASH_EraseSector(uint32_t FLASH_Addr)
   status = FLASH_WaitForLastOperation();
 	
 	/*Disable Sector Operation Protect*/
-	if(SectorProBit > FLASH_SLOCK0_SIZE)
+	if(SectorProBit >= FLASH_SLOCK0_SIZE)
 	{
 		/* Disable the write protection for flash registers */
 		FLASH->BYPASS = 0x5A5A;
@@ -184,11 +186,13 @@ FLASH_Status FLASH_ProgramWord(uint32_t Address, uint32_t Data)
 	/* Check the parameters */
   assert_param(IS_FLASH_ADDRESS(Address));
 	
+	SectorProBit = Address/FLASH_SECTOR_SIZE;
+	
   /* Wait for last operation to be completed */
   status = FLASH_WaitForLastOperation();
 	
 	/*Disable Sector Operation Protect*/
-	if(SectorProBit > FLASH_SLOCK0_SIZE)
+	if(SectorProBit >= FLASH_SLOCK0_SIZE)
 	{
 		/* Disable the write protection for flash registers */
 		FLASH->BYPASS = 0x5A5A;
@@ -253,11 +257,13 @@ FLASH_Status FLASH_ProgramHalfWord(uint32_t Address, uint16_t Data)
 	/* Check the parameters */
   assert_param(IS_FLASH_ADDRESS(Address));
 	
+	SectorProBit = Address/FLASH_SECTOR_SIZE;
+	
   /* Wait for last operation to be completed */
   status = FLASH_WaitForLastOperation();
 	
 	/*Disable Sector Operation Protect*/
-	if(SectorProBit > FLASH_SLOCK0_SIZE)
+	if(SectorProBit >= FLASH_SLOCK0_SIZE)
 	{
 		/* Disable the write protection for flash registers */
 		FLASH->BYPASS = 0x5A5A;
@@ -322,11 +328,13 @@ FLASH_Status FLASH_ProgramByte(uint32_t Address, uint8_t Data)
 	/* Check the parameters */
   assert_param(IS_FLASH_ADDRESS(Address));
 	
+	SectorProBit = Address/FLASH_SECTOR_SIZE;
+	
   /* Wait for last operation to be completed */
   status = FLASH_WaitForLastOperation();
 	
 	/*Disable Sector Operation Protect*/
-	if(SectorProBit > FLASH_SLOCK0_SIZE)
+	if(SectorProBit >= FLASH_SLOCK0_SIZE)
 	{
 		/* Disable the write protection for flash registers */
 		FLASH->BYPASS = 0x5A5A;
@@ -372,6 +380,126 @@ FLASH_Status FLASH_ProgramByte(uint32_t Address, uint8_t Data)
   return status;
 }
 
+/**
+  * @brief  Programs a buffer, unlocking the sectors and setting up the
+  *         program operation once for all of its words.
+  *
+  * @note   Address must be word aligned. Data may have any alignment, a last
+  *         partial word is padded with 0xFF. The range may cross sectors, the
+  *         sector lock bits are restored on return.
+  *
+  * @note   In FLASH_BUFFER_SKIP_SAME mode each word is read first and is not
+  *         programmed if it already holds the data, nor if it would need a
+  *         bit back from 0 to 1 (that needs an erase).
+  *
+  * @param  Address: specifies the first address to be programmed.
+  * @param  Data: specifies the bytes to be programmed.
+  * @param  Length: specifies the number of bytes.
+  * @param  Mode: FLASH_BUFFER_WRITE or FLASH_BUFFER_SKIP_SAME.
+  * @retval FLASH Status: The returned value can be: FLASH_COMPLETE, 
+  *         FLASH_ERROR_PROGRAM if a word does not hold its data afterwards.
+  */
+FLASH_Status FLASH_ProgramBuffer(uint32_t Address, const uint8_t *Data, uint32_t Length, uint32_t Mode)
+{
+  uint32_t slock0, slock1;
+  uint32_t unlock0 = 0x0, unlock1 = 0x0;
+  uint32_t SectorProBit;
+  uint32_t word, cur;
+  uint32_t i, n;
+  FLASH_Status status = FLASH_COMPLETE;
+	/* Check the parameters */
+  assert_param(IS_FLASH_ADDRESS(Address));
+  assert_param(IS_FLASH_BUFFER_MODE(Mode));
+	
+	if(Length == 0)
+	{
+		return FLASH_COMPLETE;
+	}
+	
+	/*Sectors of the range, one lock bit per two sectors*/
+	for(SectorProBit = Address/FLASH_SECTOR_SIZE; SectorProBit <= (Address + Length - 1)/FLASH_SECTOR_SIZE; SectorProBit++)
+	{
+		if(SectorProBit >= FLASH_SLOCK0_SIZE)
+		{
+			unlock1 |= (uint32_t)(0x01<<((SectorProBit-FLASH_SLOCK0_SIZE)/2));
+		}
+		else
+		{
+			unlock0 |= (uint32_t)(0x01<<((SectorProBit)/2));
+		}
+	}
+	
+  /* Wait for last operation to be completed */
+  FLASH_WaitForLastOperation();
+	
+	/*Disable Sector Operation Protect, once*/
+	slock0 = FLASH->SLOCK0;
+	slock1 = FLASH->SLOCK1;
+	FLASH->BYPASS = 0x5A5A;
+	FLASH->BYPASS = 0xA5A5;
+	FLASH->SLOCK0 = slock0 | unlock0;
+	FLASH->BYPASS = 0x5A5A;
+	FLASH->BYPASS = 0xA5A5;
+	FLASH->SLOCK1 = slock1 | unlock1;
+	
+	/*Program operation, once*/
+	FLASH->BYPASS = 0x5A5A;
+	FLASH->BYPASS = 0xA5A5;
+	FLASH->CR  &= FLASH_OPERATION_MASK;
+	FLASH->BYPASS = 0x5A5A;
+	FLASH->BYPASS = 0xA5A5;
+	FLASH->CR |= FLASH_PROGRAM; 
+	
+	for(i = 0; i < Length; i += 4)
+	{
+		/* Little endian word, 0xFF past the end */
+		n = ((Length - i) < 4) ? (Length - i) : 4;
+		word = 0xFFFFFFFF;
+		while(n--)
+		{
+			word = (word & ~((uint32_t)0xFF << (n*8))) | ((uint32_t)Data[i+n] << (n*8));
+		}
+		
+		if(Mode == FLASH_BUFFER_SKIP_SAME)
+		{
+			cur = *(__IO uint32_t*)(Address + i);
+			if(cur == word)
+			{
+				continue;
+			}
+			if((cur & word) != word)
+			{
+				status = FLASH_ERROR_PROGRAM;
+				continue;
+			}
+		}
+		
+		*(__IO uint32_t*)(Address + i) = word;
+		
+		/* Wait for last operation to be completed */
+		FLASH_WaitForLastOperation();
+		
+		if(*(__IO uint32_t*)(Address + i) != word)
+		{
+			status = FLASH_ERROR_PROGRAM;
+		}
+	}
+	
+	/* disable the PG Bit, restore the sector protection */
+	FLASH->BYPASS = 0x5A5A;
+	FLASH->BYPASS = 0xA5A5;
+	FLASH->CR  &= FLASH_OPERATION_MASK;
+	FLASH->BYPASS = 0x5A5A;
+	FLASH->BYPASS = 0xA5A5;
+	FLASH->SLOCK0 = slock0;
+	FLASH->BYPASS = 0x5A5A;
+	FLASH->BYPASS = 0xA5A5;
+	FLASH->SLOCK1 = slock1;
+	
+  /* Return the Program Status */
+  return status;
+}
+
 /**
   * @brief  Enables or disables the write protection of the desired sectors, for the first
   * @param  Newstate: new state of the Write Protection.
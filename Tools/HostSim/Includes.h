@@ -0,0 +1,27 @@
+#ifndef _INCLUDES_H_
+#define _INCLUDES_H_
+
+/* host build of the USER modules: found before USER/inc/Includes.h by -I.,
+   same module headers, BSP.h/FastIo.h replaced by the mocks in host.h */
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include "cx32l003_gpio.h"
+#include "cx32l003_flash.h"
+#include "cx32l003_crc.h"
+
+#define TRACE_ON            0
+
+#include "Spi.h"
+#include "Ble.h"
+#include "RxQueue.h"
+#include "RxFilter.h"
+#include "Timebase.h"
+#include "RxWin.h"
+#include "Tickless.h"
+#include "Trace.h"
+#include "Kv.h"
+#include "ScanLog.h"
+#include "host.h"
+
+#endif
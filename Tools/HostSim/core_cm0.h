@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file    :core_cm0.h
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :host stand-in for the CMSIS Cortex-M0 core header. cx32l003.h
+  *           finds it first with -I. (see the build lines). interrupt
+  *           masking, NVIC and __WFI go to the cost model in host.c
+  ******************************************************************************
+***/
+
+#ifndef __CORE_CM0_H_GENERIC
+#define __CORE_CM0_H_GENERIC
+
+#include <stdint.h>
+
+#define __I                 volatile const
+#define __O                 volatile
+#define __IO                volatile
+#define __INLINE            inline
+#define __STATIC_INLINE     static inline
+#define __ASM               __asm
+
+typedef struct
+{
+    __I  uint32_t CPUID;
+    __IO uint32_t ICSR;
+    uint32_t RESERVED0;
+    __IO uint32_t AIRCR;
+    __IO uint32_t SCR;
+    __IO uint32_t CCR;
+}SCB_Type;
+
+extern SCB_Type host_scb;
+#define SCB                 (&host_scb)
+
+extern void __enable_irq(void);
+extern void __disable_irq(void);
+extern uint32_t __get_PRIMASK(void);
+extern void __set_PRIMASK(uint32_t primask);
+extern void __WFI(void);
+
+#define __NOP()
+#define __DSB()
+#define __ISB()
+#define __DMB()
+
+extern void NVIC_EnableIRQ(IRQn_Type irq);
+extern void NVIC_DisableIRQ(IRQn_Type irq);
+extern void NVIC_SetPendingIRQ(IRQn_Type irq);
+extern void NVIC_ClearPendingIRQ(IRQn_Type irq);
+extern void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+
+#endif
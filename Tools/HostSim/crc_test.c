@@ -0,0 +1,187 @@
+/**
+  ******************************************************************************
+  * @file    :crc_test.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :CRC_Stream*16/32 of cx32l003_crc.c, software path: known
+  *           vectors, bitwise reference, split and unaligned spans
+  ******************************************************************************
+  * build:  cc -Wall -Wextra -I. -I../../adv_trx/USER/inc -I../../FWLB/inc
+  *            -I../../DEVICE -o crc_test crc_test.c host.c
+  *            ../../FWLB/src/cx32l003_crc.c
+  * use:    crc_test        exit code 1 if a check fails
+  *         the CRC_STREAM_HW path needs the chip, see cx32l003_crc.h
+***/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Includes.h"
+#include "cx32l003_rcc.h"
+
+#define TEST_LEN            300
+
+static uint8_t buf[TEST_LEN + 4];
+static uint32_t rnd = 1;
+static int failed;
+
+//CRC_DeInit, not used here
+void RCC_PeriphResetCmd(RCC_TypeDef *RCCx, uint32_t Periph, FunctionalState NewState)
+{
+    (void)RCCx;
+    (void)Periph;
+    (void)NewState;
+}
+
+static uint32_t Rand(void)
+{
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd;
+}
+
+/*******************************************************************************
+* Function   :     	Ref16
+* Parameter  :     	const uint8_t *data, uint32_t len
+* Returns    :     	uint16_t, CRC-16/X-25
+* Description:      bit by bit from the polynomial, no tables
+* Note:      :
+*******************************************************************************/
+static uint16_t Ref16(const uint8_t *data, uint32_t len)
+{
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+
+    while(len--){
+        crc ^= *data++;
+        for(i = 0; i < 8; i++) crc = (crc & 1) ? ((crc >> 1) ^ 0x8408) : (crc >> 1);
+    }
+    return crc ^ 0xFFFF;
+}
+
+/*******************************************************************************
+* Function   :     	Ref32
+* Parameter  :     	const uint8_t *data, uint32_t len
+* Returns    :     	uint32_t, CRC-32 IEEE 802.3
+* Description:      bit by bit from the polynomial, no tables
+* Note:      :
+*******************************************************************************/
+static uint32_t Ref32(const uint8_t *data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFFUL;
+    uint8_t i;
+
+    while(len--){
+        crc ^= *data++;
+        for(i = 0; i < 8; i++) crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320UL) : (crc >> 1);
+    }
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+static uint16_t Crc16(const uint8_t *data, uint32_t len)
+{
+    CRC_Ctx16TypeDef ctx;
+
+    CRC_StreamInit16(&ctx);
+    CRC_StreamUpdate16(&ctx, data, len);
+    return CRC_StreamFinal16(&ctx);
+}
+
+static uint32_t Crc32(const uint8_t *data, uint32_t len)
+{
+    CRC_Ctx32TypeDef ctx;
+
+    CRC_StreamInit32(&ctx);
+    CRC_StreamUpdate32(&ctx, data, len);
+    return CRC_StreamFinal32(&ctx);
+}
+
+/*******************************************************************************
+* Function   :     	Check
+* Parameter  :     	const char *what, int ok
+* Returns    :     	void
+* Description:
+* Note:      :
+*******************************************************************************/
+static void Check(const char *what, int ok)
+{
+    printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+    if(!ok) failed = 1;
+}
+
+/*******************************************************************************
+* Function   :     	Test_Vectors
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      published check values
+* Note:      :
+*******************************************************************************/
+static void Test_Vectors(void)
+{
+    static const uint8_t check[] = "123456789";
+    static const uint8_t fox[] = "The quick brown fox jumps over the lazy dog";
+
+    Check("x25: \"123456789\" = 0x906E", Crc16(check, 9) == 0x906E);
+    Check("x25: empty = 0x0000", Crc16(check, 0) == 0x0000);
+    Check("crc32: \"123456789\" = 0xCBF43926", Crc32(check, 9) == 0xCBF43926UL);
+    Check("crc32: empty = 0x00000000", Crc32(check, 0) == 0);
+    Check("crc32: \"a\" = 0xE8B7BE43", Crc32((const uint8_t *)"a", 1) == 0xE8B7BE43UL);
+    Check("crc32: fox = 0x414FA339", Crc32(fox, sizeof(fox) - 1) == 0x414FA339UL);
+    Check("x25: fox = bitwise reference", Crc16(fox, sizeof(fox) - 1) == Ref16(fox, sizeof(fox) - 1));
+}
+
+/*******************************************************************************
+* Function   :     	Test_Stream
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      random data, every length, start alignment and split point
+*                   against the bitwise reference
+* Note:      :      Final may be called and the stream continued
+*******************************************************************************/
+static void Test_Stream(void)
+{
+    CRC_Ctx16TypeDef c16;
+    CRC_Ctx32TypeDef c32;
+    uint32_t len;
+    uint32_t cut;
+    uint32_t off;
+    uint32_t i;
+    uint32_t bad16 = 0;
+    uint32_t bad32 = 0;
+    uint32_t bad_split = 0;
+
+    for(i = 0; i < sizeof(buf); i++) buf[i] = (uint8_t)Rand();
+
+    for(off = 0; off < 4; off++){
+        for(len = 0; len <= TEST_LEN; len++){
+            if(Crc16(buf + off, len) != Ref16(buf + off, len)) bad16++;
+            if(Crc32(buf + off, len) != Ref32(buf + off, len)) bad32++;
+        }
+    }
+    Check("x25: lengths 0..300, 4 alignments", bad16 == 0);
+    Check("crc32: lengths 0..300, 4 alignments", bad32 == 0);
+
+    for(off = 0; off < 4; off++){
+        for(cut = 0; cut <= 64; cut++){
+            CRC_StreamInit16(&c16);
+            CRC_StreamInit32(&c32);
+            CRC_StreamUpdate16(&c16, buf + off, cut);
+            CRC_StreamUpdate32(&c32, buf + off, cut);
+            if(CRC_StreamFinal16(&c16) != Ref16(buf + off, cut)) bad_split++;
+            CRC_StreamUpdate16(&c16, buf + off + cut, 64 - cut);
+            CRC_StreamUpdate32(&c32, buf + off + cut, 64 - cut);
+            if(CRC_StreamFinal16(&c16) != Ref16(buf + off, 64)) bad_split++;
+            if(CRC_StreamFinal32(&c32) != Ref32(buf + off, 64)) bad_split++;
+        }
+    }
+    Check("split: two spans = one span, Final in between", bad_split == 0);
+}
+
+int main(void)
+{
+    Test_Vectors();
+    Test_Stream();
+    return failed;
+}
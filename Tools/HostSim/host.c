@@ -0,0 +1,435 @@
+/**
+  ******************************************************************************
+  * @file    :host.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :MCU cost model for the host builds of the USER modules, see host.h
+  *           CMSIS core calls (core_cm0.h), FastIo.h SPI/GPIO, SPI0COMB_IRQn,
+  *           FLASH_ erase/program on a memory image
+  ******************************************************************************
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "Includes.h"
+
+#define HOST_NEVER          UINT64_MAX
+
+SCB_Type host_scb;
+
+uint64_t host_cyc;
+uint64_t host_busy;
+uint64_t host_sleep;
+uint32_t host_irq_cnt;
+uint32_t host_irq_cyc = HOST_IRQ_CYC;
+
+uint32_t host_spi_div = 4;
+uint32_t host_spi_err;
+uint16_t host_spi_log[HOST_SPI_LOG_MAX];
+uint32_t host_spi_len;
+
+uint32_t host_flash_erase[HOST_FLASH_SECTORS];
+uint32_t host_flash_prog;
+uint32_t host_flash_err;
+uint32_t host_flash_cut;
+jmp_buf host_flash_jmp;
+
+static uint32_t host_primask;
+static uint32_t host_irq_en;        //NVIC enable bits
+static uint8_t host_in_irq;
+static uint8_t host_csn = 1;
+static uint8_t host_spi_run;        //byte on the bus or SPIF set
+static uint64_t host_spi_done;      //SPIF from this cycle
+
+
+/*******************************************************************************
+* Function   :     	SPI0COMB_IRQHandler
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      default for builds without Spi.c
+* Note:      :
+*******************************************************************************/
+__attribute__((weak)) void SPI0COMB_IRQHandler(void)
+{
+}
+
+/*******************************************************************************
+* Function   :     	Host_Run
+* Parameter  :     	uint32_t cyc
+* Returns    :     	void
+* Description:      the CPU runs for cyc
+* Note:      :
+*******************************************************************************/
+static void Host_Run(uint32_t cyc)
+{
+    host_cyc += cyc;
+    host_busy += cyc;
+}
+
+/*******************************************************************************
+* Function   :     	Host_Due
+* Parameter  :     	void
+* Returns    :     	uint64_t, cycle the SPI interrupt is pending from
+* Description:
+* Note:      :      HOST_NEVER: none coming
+*******************************************************************************/
+static uint64_t Host_Due(void)
+{
+    if(!(host_irq_en & (1UL << SPI0COMB_IRQn)) || !host_spi_run) return HOST_NEVER;
+    return host_spi_done;
+}
+
+/*******************************************************************************
+* Function   :     	Host_Take
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      run the pending handlers, if not masked
+* Note:      :      no nesting, one level is all the modules need
+*******************************************************************************/
+static void Host_Take(void)
+{
+    while(!host_primask && !host_in_irq && (Host_Due() <= host_cyc))
+    {
+        host_in_irq = 1;
+        Host_Run(host_irq_cyc);
+        host_irq_cnt++;
+        SPI0COMB_IRQHandler();
+        host_in_irq = 0;
+    }
+}
+
+/*******************************************************************************
+* Function   :     	Host_Reset
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      time, counters and the SPI log back to 0
+* Note:      :      keeps host_spi_div and host_irq_cyc
+*******************************************************************************/
+void Host_Reset(void)
+{
+    host_cyc = 0;
+    host_busy = 0;
+    host_sleep = 0;
+    host_irq_cnt = 0;
+    host_spi_err = 0;
+    host_spi_len = 0;
+    host_spi_run = 0;
+    host_csn = 1;
+}
+
+/*******************************************************************************
+* Function   :     	Host_Cpu
+* Parameter  :     	uint32_t cyc
+* Returns    :     	void
+* Description:      thread work of cyc cycles, interrupts taken when due
+* Note:      :
+*******************************************************************************/
+void Host_Cpu(uint32_t cyc)
+{
+    uint64_t due;
+    uint32_t step;
+
+    while(cyc)
+    {
+        due = host_primask ? HOST_NEVER : Host_Due();
+        if(due >= host_cyc + cyc){
+            Host_Run(cyc);
+            break;
+        }
+        step = (due > host_cyc) ? (uint32_t)(due - host_cyc) : 0;
+        Host_Run(step);
+        cyc -= step;
+        Host_Take();
+    }
+}
+
+void __enable_irq(void)
+{
+    host_primask = 0;
+    Host_Take();
+}
+
+void __disable_irq(void)
+{
+    host_primask = 1;
+}
+
+uint32_t __get_PRIMASK(void)
+{
+    return host_primask;
+}
+
+void __set_PRIMASK(uint32_t primask)
+{
+    host_primask = primask;
+    Host_Take();
+}
+
+/*******************************************************************************
+* Function   :     	__WFI
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      sleep until the next interrupt is pending
+* Note:      :      wakes with PRIMASK set too, as the core does
+*******************************************************************************/
+void __WFI(void)
+{
+    uint64_t due = Host_Due();
+
+    if(due == HOST_NEVER){
+        fprintf(stderr, "__WFI at %llu: no interrupt will come\n", (unsigned long long)host_cyc);
+        exit(2);
+    }
+    if(due > host_cyc){
+        host_sleep += due - host_cyc;
+        host_cyc = due;
+    }
+    Host_Take();
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq)
+{
+    host_irq_en |= 1UL << irq;
+    Host_Take();
+}
+
+void NVIC_DisableIRQ(IRQn_Type irq)
+{
+    host_irq_en &= ~(1UL << irq);
+}
+
+void NVIC_SetPendingIRQ(IRQn_Type irq)
+{
+    (void)irq;
+}
+
+void NVIC_ClearPendingIRQ(IRQn_Type irq)
+{
+    (void)irq;  //pending follows SPIF here
+}
+
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority)
+{
+    (void)irq;
+    (void)priority;
+}
+
+/*******************************************************************************
+* Function   :     	FIO_Spi_Put
+* Parameter  :     	uint8_t data
+* Returns    :     	void
+* Description:      start a byte, SPIF after 8*host_spi_div cycles
+* Note:      :
+*******************************************************************************/
+void FIO_Spi_Put(uint8_t data)
+{
+    Host_Run(HOST_FIO_CYC);
+    if(host_spi_run || host_csn) host_spi_err++;
+    if(host_spi_len < HOST_SPI_LOG_MAX) host_spi_log[host_spi_len++] = data;
+    host_spi_run = 1;
+    host_spi_done = host_cyc + 8*host_spi_div;
+}
+
+/*******************************************************************************
+* Function   :     	FIO_Spi_Done
+* Parameter  :     	void
+* Returns    :     	uint32_t, SPIF
+* Description:      polled by the thread: spins until the byte is out
+* Note:      :
+*******************************************************************************/
+uint32_t FIO_Spi_Done(void)
+{
+    Host_Run(HOST_FIO_CYC);
+    if(!host_spi_run) return 0;
+    if(host_spi_done > host_cyc) Host_Run((uint32_t)(host_spi_done - host_cyc));
+    return 1;
+}
+
+uint8_t FIO_Spi_Get(void)
+{
+    Host_Run(HOST_FIO_CYC);
+    host_spi_run = 0;
+    return 0xFF;
+}
+
+void FIO_Set(GPIO_TypeDef *port, uint16_t pin)
+{
+    Host_Run(HOST_FIO_CYC);
+    if((port == BLE_CSN_PORT) && (pin == BLE_CSN_PIN) && !host_csn){
+        host_csn = 1;
+        if(host_spi_len < HOST_SPI_LOG_MAX) host_spi_log[host_spi_len++] = HOST_SPI_CSN;
+    }
+}
+
+void FIO_Clr(GPIO_TypeDef *port, uint16_t pin)
+{
+    Host_Run(HOST_FIO_CYC);
+    if((port == BLE_CSN_PORT) && (pin == BLE_CSN_PIN)) host_csn = 0;
+}
+
+uint32_t FIO_Get(GPIO_TypeDef *port, uint16_t pin)
+{
+    (void)port;
+    (void)pin;
+    Host_Run(HOST_FIO_CYC);
+    return 0;
+}
+
+//FWLB, SPI_Csn_Init
+void GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_InitStruct)
+{
+    (void)GPIOx;
+    (void)GPIO_InitStruct;
+}
+
+void GPIO_SetBits(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    FIO_Set(GPIOx, GPIO_Pin);
+}
+
+/*******************************************************************************
+* Function   :     	Host_Flash_Init
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      map the image at HOST_FLASH_BASE on the first call, erase
+*                   it, counters to 0
+* Note:      :      host_flash_cut back to never
+*******************************************************************************/
+void Host_Flash_Init(void)
+{
+    static uint8_t mapped;
+    void *p;
+
+    if(!mapped){
+        p = mmap((void *)HOST_FLASH_BASE, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if(p != (void *)HOST_FLASH_BASE){
+            fprintf(stderr, "flash image: 0x%08lX is not free\n", HOST_FLASH_BASE);
+            exit(2);
+        }
+        mapped = 1;
+    }
+    memset((void *)HOST_FLASH_BASE, 0xFF, HOST_FLASH_SIZE);
+    memset(host_flash_erase, 0, sizeof(host_flash_erase));
+    host_flash_prog = 0;
+    host_flash_err = 0;
+    host_flash_cut = 0;
+}
+
+/*******************************************************************************
+* Function   :     	Host_Flash_Addr
+* Parameter  :     	uint32_t addr, uint32_t len
+* Returns    :     	volatile uint32_t *, the word at addr
+* Description:      exits on an address outside the image or not aligned
+* Note:      :
+*******************************************************************************/
+static volatile uint32_t *Host_Flash_Addr(uint32_t addr, uint32_t len)
+{
+    if((addr & 3) || (addr < HOST_FLASH_BASE) || (addr + len > HOST_FLASH_BASE + HOST_FLASH_SIZE)){
+        fprintf(stderr, "flash: 0x%08lX + %lu outside the image\n", (unsigned long)addr, (unsigned long)len);
+        exit(2);
+    }
+    return (volatile uint32_t *)(uintptr_t)addr;
+}
+
+/*******************************************************************************
+* Function   :     	Host_Flash_Cut
+* Parameter  :     	void
+* Returns    :     	uint8_t, 1: the power fails in this operation
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t Host_Flash_Cut(void)
+{
+    return host_flash_cut && (--host_flash_cut == 0);
+}
+
+/*******************************************************************************
+* Function   :     	Host_Flash_Word
+* Parameter  :     	uint32_t addr, uint32_t data
+* Returns    :     	FLASH_Status
+* Description:      program one word: bits only go to 0, verified
+* Note:      :      power cut: half the bits programmed, then host_flash_jmp
+*******************************************************************************/
+static FLASH_Status Host_Flash_Word(uint32_t addr, uint32_t data)
+{
+    volatile uint32_t *w = Host_Flash_Addr(addr, 4);
+
+    if(Host_Flash_Cut()){
+        *w &= data | 0xFFFF0000UL;
+        longjmp(host_flash_jmp, 1);
+    }
+    host_flash_prog++;
+    *w &= data;
+    if(*w != data){
+        host_flash_err++;
+        return FLASH_ERROR_PROGRAM;
+    }
+    return FLASH_COMPLETE;
+}
+
+/*******************************************************************************
+* Function   :     	FLASH_EraseSector
+* Parameter  :     	uint32_t FLASH_Addr, any address in the sector
+* Returns    :     	FLASH_Status
+* Description:      sector to 0xFF, counted in host_flash_erase
+* Note:      :      power cut: the first half erased, then host_flash_jmp
+*******************************************************************************/
+FLASH_Status FLASH_EraseSector(uint32_t FLASH_Addr)
+{
+    uint32_t addr = FLASH_Addr & ~(FLASH_SECTOR_SIZE - 1UL);
+
+    Host_Flash_Addr(addr, FLASH_SECTOR_SIZE);
+    if(Host_Flash_Cut()){
+        memset((void *)(uintptr_t)addr, 0xFF, FLASH_SECTOR_SIZE/2);
+        longjmp(host_flash_jmp, 1);
+    }
+    host_flash_erase[(addr - HOST_FLASH_BASE)/FLASH_SECTOR_SIZE]++;
+    memset((void *)(uintptr_t)addr, 0xFF, FLASH_SECTOR_SIZE);
+    return FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_ProgramWord(uint32_t Address, uint32_t Data)
+{
+    return Host_Flash_Word(Address, Data);
+}
+
+/*******************************************************************************
+* Function   :     	FLASH_ProgramBuffer
+* Parameter  :     	uint32_t Address, const uint8_t *Data, uint32_t Length
+*                   uint32_t Mode, FLASH_BUFFER_WRITE or FLASH_BUFFER_SKIP_SAME
+* Returns    :     	FLASH_Status
+* Description:      as cx32l003_flash.c: little endian words, 0xFF past the end
+* Note:      :
+*******************************************************************************/
+FLASH_Status FLASH_ProgramBuffer(uint32_t Address, const uint8_t *Data, uint32_t Length, uint32_t Mode)
+{
+    FLASH_Status status = FLASH_COMPLETE;
+    uint32_t word;
+    uint32_t cur;
+    uint32_t i;
+    uint32_t n;
+
+    for(i = 0; i < Length; i += 4)
+    {
+        n = ((Length - i) < 4) ? (Length - i) : 4;
+        word = 0xFFFFFFFFUL;
+        while(n--){
+            word = (word & ~(0xFFUL << (n*8))) | ((uint32_t)Data[i+n] << (n*8));
+        }
+        if(Mode == FLASH_BUFFER_SKIP_SAME){
+            cur = *Host_Flash_Addr(Address + i, 4);
+            if(cur == word) continue;
+            if((cur & word) != word){
+                host_flash_err++;
+                status = FLASH_ERROR_PROGRAM;
+                continue;
+            }
+        }
+        if(Host_Flash_Word(Address + i, word) != FLASH_COMPLETE) status = FLASH_ERROR_PROGRAM;
+    }
+    return status;
+}
@@ -0,0 +1,59 @@
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdint.h>
+#include <setjmp.h>
+
+/* MCU cost model for the host builds, host.c. time counts HCLK cycles, the
+   thread runs only in Host_Cpu() and between FIO calls, interrupts are taken
+   there, in __enable_irq/NVIC_EnableIRQ and in __WFI. rough Cortex-M0+ costs,
+   not cycle exact: compare runs with each other, not with the target */
+#define HOST_FIO_CYC        3       //FIO_ register access incl. the call
+#define HOST_IRQ_CYC        48      //exception entry/exit + handler bookkeeping
+
+#define HOST_SPI_CSN        0x100   //host_spi_log: CSN went high
+#define HOST_SPI_LOG_MAX    4096
+
+/* flash: 64KB NOR image at HOST_FLASH_BASE, the FLASH_ calls of the modules
+   act on it. programming only clears bits, a word is verified as on the chip.
+   the modules address it with -DKV_BASE=0x1000F800UL -DSL_BASE=0x1000E800UL */
+#define HOST_FLASH_BASE     0x10000000UL
+#define HOST_FLASH_SIZE     0x10000UL
+#define HOST_FLASH_SECTORS  (HOST_FLASH_SIZE/FLASH_SECTOR_SIZE)
+
+extern uint64_t host_cyc;           //now
+extern uint64_t host_busy;          //CPU running, thread and handlers
+extern uint64_t host_sleep;         //CPU in __WFI
+extern uint32_t host_irq_cnt;       //handlers run
+extern uint32_t host_irq_cyc;       //HOST_IRQ_CYC by default
+
+extern uint32_t host_spi_div;       //SPI prescaler, a byte takes 8*div cycles
+extern uint32_t host_spi_err;       //DATA written while busy or CSN high
+extern uint16_t host_spi_log[HOST_SPI_LOG_MAX];   //MOSI bytes and HOST_SPI_CSN
+extern uint32_t host_spi_len;
+
+extern uint32_t host_flash_erase[HOST_FLASH_SECTORS];  //erases per sector
+extern uint32_t host_flash_prog;    //words programmed
+extern uint32_t host_flash_err;     //words that needed a 0 bit set to 1
+extern uint32_t host_flash_cut;     //power fails in the n-th erase/word, 0: never
+extern jmp_buf host_flash_jmp;      //where the power cut returns to, value 1
+
+extern void Host_Reset(void);
+extern void Host_Cpu(uint32_t cyc);
+extern void Host_Flash_Init(void);
+
+//FastIo.h
+extern void FIO_Spi_Put(uint8_t data);
+extern uint32_t FIO_Spi_Done(void);
+extern uint8_t FIO_Spi_Get(void);
+extern void FIO_Set(GPIO_TypeDef *port, uint16_t pin);
+extern void FIO_Clr(GPIO_TypeDef *port, uint16_t pin);
+extern uint32_t FIO_Get(GPIO_TypeDef *port, uint16_t pin);
+
+//BSP.h, defined by the test that needs them
+extern uint8_t Uart_Put(const char *data, uint16_t len);
+extern void Uart_Flush(void);
+
+extern void SPI0COMB_IRQHandler(void);
+
+#endif
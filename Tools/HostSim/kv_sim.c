@@ -0,0 +1,304 @@
+/**
+  ******************************************************************************
+  * @file    :kv_sim.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :Kv.c on the host flash image: set/get/delete, the KV_LIVE_MAX
+  *           limit, power cut at every flash operation, wear per sector
+  ******************************************************************************
+  * build:  cc -O2 -Wall -Wextra -Wno-int-to-pointer-cast -I.
+  *            -I../../adv_trx/USER/inc -I../../FWLB/inc -I../../DEVICE
+  *            -DKV_BASE=0x1000F800UL -o kv_sim kv_sim.c host.c
+  *            ../../adv_trx/USER/src/Kv.c ../../FWLB/src/cx32l003_crc.c
+  * use:    kv_sim          exit code 1 if a check fails
+***/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Includes.h"
+#include "cx32l003_rcc.h"
+
+#define SIM_CUT_SETS        400     //sets after each power cut
+#define SIM_WEAR_SETS       100000UL
+#define SIM_ENDURANCE       10000UL //erase cycles per sector, assumed
+
+typedef struct
+{
+    uint8_t val[KV_KEY_MAX][KV_VAL_MAX];
+    uint8_t len[KV_KEY_MAX];
+}RefTypeDef;
+
+typedef struct
+{
+    uint8_t key;
+    uint8_t len;
+    uint8_t val[KV_VAL_MAX];
+}SetTypeDef;
+
+static RefTypeDef ref;
+static SetTypeDef pend;             //set in progress
+static uint32_t rnd = 1;
+static int failed;
+
+//CRC_DeInit, not used here
+void RCC_PeriphResetCmd(RCC_TypeDef *RCCx, uint32_t Periph, FunctionalState NewState)
+{
+    (void)RCCx;
+    (void)Periph;
+    (void)NewState;
+}
+
+static uint32_t Rand(void)
+{
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd;
+}
+
+/*******************************************************************************
+* Function   :     	Check
+* Parameter  :     	const char *what, int ok
+* Returns    :     	void
+* Description:
+* Note:      :
+*******************************************************************************/
+static void Check(const char *what, int ok)
+{
+    printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+    if(!ok) failed = 1;
+}
+
+/*******************************************************************************
+* Function   :     	Same
+* Parameter  :     	uint8_t key, const uint8_t *val, uint8_t len
+* Returns    :     	uint8_t, 1: KV_Get returns this value
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t Same(uint8_t key, const uint8_t *val, uint8_t len)
+{
+    uint8_t buf[KV_VAL_MAX];
+
+    return (KV_Get(key, buf, sizeof(buf)) == len) && !memcmp(buf, val, len);
+}
+
+/*******************************************************************************
+* Function   :     	Ref_Match
+* Parameter  :     	uint8_t skip, key left out, KV_KEY_MAX: none
+* Returns    :     	uint8_t, 1: every key reads as in ref
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t Ref_Match(uint8_t skip)
+{
+    uint8_t key;
+
+    for(key = 0; key < KV_KEY_MAX; key++){
+        if((key != skip) && !Same(key, ref.val[key], ref.len[key])) return 0;
+    }
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	Ref_Set
+* Parameter  :     	uint8_t keys, uint8_t max, value length 1..max
+* Returns    :     	uint8_t, KV_Set result
+* Description:      a random value to one of the first keys, ref follows
+* Note:      :      one in 8 is a delete. kept in pend while KV_Set runs
+*******************************************************************************/
+static uint8_t Ref_Set(uint8_t keys, uint8_t max)
+{
+    uint8_t i;
+
+    pend.key = (uint8_t)(Rand() % keys);
+    pend.len = (Rand() % 8) ? (uint8_t)(1 + Rand() % max) : 0;
+    for(i = 0; i < pend.len; i++) pend.val[i] = (uint8_t)Rand();
+    if(!KV_Set(pend.key, pend.val, pend.len)) return 0;
+    memcpy(ref.val[pend.key], pend.val, pend.len);
+    ref.len[pend.key] = pend.len;
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	Test_Basic
+* Parameter  :     	void
+* Returns    :     	void
+* Description:
+* Note:      :
+*******************************************************************************/
+static void Test_Basic(void)
+{
+    static const uint8_t a[] = {1, 2, 3};
+    static const uint8_t b[] = {4, 5, 6, 7, 8};
+    uint8_t buf[KV_VAL_MAX];
+    uint32_t prog;
+
+    Host_Flash_Init();
+    KV_Init();
+    Check("basic: blank area formats, nothing set", KV_Get(0, buf, sizeof(buf)) == 0);
+    Check("basic: set, get", KV_Set(3, a, sizeof(a)) && Same(3, a, sizeof(a)));
+    Check("basic: overwrite, other length", KV_Set(3, b, sizeof(b)) && Same(3, b, sizeof(b)));
+    prog = host_flash_prog;
+    Check("basic: unchanged set writes nothing", KV_Set(3, b, sizeof(b)) && (prog == host_flash_prog));
+    Check("basic: bad key and length refused", !KV_Set(KV_KEY_MAX, a, 1) && !KV_Set(0, buf, KV_VAL_MAX + 1));
+    Check("basic: delete", KV_Del(3) && (KV_Get(3, buf, sizeof(buf)) == 0));
+    KV_Set(5, a, sizeof(a));
+    KV_Init();
+    Check("basic: KV_Init finds the values again", Same(5, a, sizeof(a)) && (KV_Get(3, buf, sizeof(buf)) == 0));
+    Check("basic: no program errors", host_flash_err == 0);
+}
+
+/*******************************************************************************
+* Function   :     	Test_Full
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      KV_VAL_MAX values until KV_Set refuses: the area keeps
+*                   working, updates in place still fit
+* Note:      :
+*******************************************************************************/
+static void Test_Full(void)
+{
+    uint8_t val[KV_VAL_MAX];
+    uint8_t key;
+    uint8_t n = 0;
+    uint32_t i;
+    uint32_t bad = 0;
+
+    Host_Flash_Init();
+    KV_Init();
+    memset(&ref, 0, sizeof(ref));
+    for(key = 0; key < KV_KEY_MAX; key++){
+        memset(val, key, sizeof(val));
+        if(!KV_Set(key, val, KV_VAL_MAX)) break;
+        memcpy(ref.val[key], val, KV_VAL_MAX);
+        ref.len[key] = KV_VAL_MAX;
+        n++;
+    }
+    printf("full: %u values of %u bytes fit, KV_LIVE_MAX %u\n", n, KV_VAL_MAX, KV_LIVE_MAX);
+    Check("full: refused at KV_LIVE_MAX", n == KV_LIVE_MAX/(4 + KV_VAL_MAX));
+    Check("full: refused set leaves the others", Ref_Match(KV_KEY_MAX));
+
+    //rewrite the full set many times over: every rotation has to reclaim all
+    for(i = 0; i < 2000; i++){
+        key = (uint8_t)(Rand() % n);
+        memset(val, (int)Rand(), sizeof(val));
+        if(!KV_Set(key, val, KV_VAL_MAX)){
+            bad++;
+            continue;
+        }
+        memcpy(ref.val[key], val, KV_VAL_MAX);
+    }
+    Check("full: updates of a full area all stored", bad == 0);
+    KV_Init();
+    Check("full: KV_Init finds the values again", Ref_Match(KV_KEY_MAX));
+    Check("full: a delete always fits", KV_Del(0) && KV_Set(0, val, 4));
+    Check("full: no program errors", host_flash_err == 0);
+}
+
+/*******************************************************************************
+* Function   :     	Test_Cut
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      the same random sets, power cut at the n-th flash operation
+*                   until the sets run out first: after KV_Init the set in progress reads old or
+*                   new, every other key as before, and the area keeps working
+* Note:      :      values up to 16 bytes on 8 keys: the area wraps often
+*******************************************************************************/
+static void Test_Cut(void)
+{
+    static uint32_t cut;
+    static uint32_t lost;
+    static uint32_t broken;
+    static uint32_t dead;
+    uint32_t i;
+    uint8_t key;
+
+    for(cut = 1; ; cut++){
+        Host_Flash_Init();
+        KV_Init();
+        memset(&ref, 0, sizeof(ref));
+        rnd = 777;
+
+        host_flash_cut = cut;
+        if(setjmp(host_flash_jmp) == 0){
+            for(i = 0; i < SIM_CUT_SETS; i++) Ref_Set(8, 16);
+            break;      //all sets done before the cut
+        }
+
+        //ref is as before the set in progress
+        KV_Init();
+        if(!Ref_Match(pend.key)) broken++;
+        else if(!Ref_Match(KV_KEY_MAX) && !Same(pend.key, pend.val, pend.len)) lost++;
+        //carry on from what is in flash
+        for(key = 0; key < KV_KEY_MAX; key++){
+            ref.len[key] = KV_Get(key, ref.val[key], KV_VAL_MAX);
+        }
+        for(i = 0; i < SIM_CUT_SETS; i++){
+            if(!Ref_Set(8, 16)) dead++;
+        }
+        KV_Init();
+        if(!Ref_Match(KV_KEY_MAX)) dead++;
+    }
+    printf("cut: power lost at flash operation 1..%u of %u sets\n", cut - 1, SIM_CUT_SETS);
+    Check("cut: set in progress reads old or new", lost == 0);
+    Check("cut: other keys unchanged", broken == 0);
+    Check("cut: area works after KV_Init", dead == 0);
+}
+
+/*******************************************************************************
+* Function   :     	Bench_Wear
+* Parameter  :     	uint8_t keys, uint8_t max, value length 1..max
+* Returns    :     	void
+* Description:      SIM_WEAR_SETS random sets: erases per sector, words
+*                   programmed per set, sets until the most worn sector reaches
+*                   SIM_ENDURANCE
+* Note:      :
+*******************************************************************************/
+static void Bench_Wear(uint8_t keys, uint8_t max)
+{
+    uint32_t lo = UINT32_MAX;
+    uint32_t hi = 0;
+    uint32_t sum = 0;
+    uint32_t refused = 0;
+    uint32_t i;
+    uint8_t s;
+
+    Host_Flash_Init();
+    KV_Init();
+    memset(&ref, 0, sizeof(ref));
+    rnd = 4242;
+    for(i = 0; i < SIM_WEAR_SETS; i++){
+        if(!Ref_Set(keys, max)) refused++;
+    }
+    for(s = 0; s < KV_SECTORS; s++){
+        i = host_flash_erase[(KV_BASE - HOST_FLASH_BASE)/FLASH_SECTOR_SIZE + s];
+        if(i < lo) lo = i;
+        if(i > hi) hi = i;
+        sum += i;
+    }
+    printf("%4u x %2u | %7u %5u %5u | %9.2f | %8.2f | %12.0f\n", keys, max, sum, lo, hi,
+           1000.0*sum/SIM_WEAR_SETS, (double)host_flash_prog/SIM_WEAR_SETS,
+           hi ? (double)SIM_ENDURANCE*SIM_WEAR_SETS/hi : 0.0);
+    if((hi > lo + 1) || refused || host_flash_err) failed = 1;
+}
+
+int main(void)
+{
+    Test_Basic();
+    Test_Full();
+    Test_Cut();
+
+    printf("\nwear: %lu random sets, 1 in 8 a delete, %u sectors of %u bytes\n",
+           SIM_WEAR_SETS, KV_SECTORS, FLASH_SECTOR_SIZE);
+    printf("sets to wear out: the most worn sector at %lu erases\n", SIM_ENDURANCE);
+    printf("keys x max | erases   min   max | per 1000 sets | words/set | sets to wear out\n");
+    Bench_Wear(2, 4);
+    Bench_Wear(7, 4);
+    Bench_Wear(8, 16);
+    Bench_Wear(13, 32);
+    Check("wear: sectors even within one erase, no refusal", !failed);
+    return failed;
+}
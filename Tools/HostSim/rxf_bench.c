@@ -0,0 +1,255 @@
+/**
+  ******************************************************************************
+  * @file    :rxf_bench.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :RxF_Is_Dup against an exact per advertiser filter: duplicates let
+  *           through (table too small), reports wrongly suppressed (fingerprint
+  *           collisions) and lookup cost, simulated advertisers
+  ******************************************************************************
+  * build:  cc -O2 -Wall -Wextra -I. -I../../adv_trx/USER/inc -I../../FWLB/inc
+  *            -I../../DEVICE -o rxf_bench rxf_bench.c host.c
+  *            ../../adv_trx/USER/src/RxFilter.c
+  *         table size: -DRXF_DUP_SETS=n -DRXF_DUP_WAYS=n, e.g.
+  *         for s in 8 16 32 64; do cc -DRXF_DUP_SETS=$s ... && ./rxf_bench; done
+  * use:    rxf_bench       exit code 1 if a check fails
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Includes.h"
+
+#define BENCH_ADV_MAX       1000
+#define BENCH_RUN_MS        60000UL
+#define BENCH_WINDOW_MS     RXF_DUP_WINDOW
+#define BENCH_ITV_MIN       100     //ms, advertising interval, per advertiser
+#define BENCH_ITV_MAX       1000
+#define BENCH_DATA_MS       10000   //ms, mean time between payload changes
+#define BENCH_EARLY_MS      132     //RxF window steps: may report this much early
+
+typedef struct
+{
+    uint8_t addr[LEN_BLE_ADDR];
+    uint32_t itv;       //ms
+    uint32_t next;      //ms, next advertising event
+    uint32_t seq;       //payload version
+    uint32_t dup_seq;   //exact filter: last reported version
+    uint32_t dup_time;  //ms, its report
+    uint32_t rep_seq;   //RxF_Is_Dup: last reported version
+    uint32_t rep_time;  //ms, its report
+    uint8_t dup_any;    //reported at least once
+    uint8_t rep_any;
+}AdvTypeDef;
+
+typedef struct
+{
+    uint32_t pdu;       //PDUs heard
+    uint32_t ideal;     //exact filter reports
+    uint32_t rep;       //RxF_Is_Dup reports
+    uint32_t again;     //reported again within the window, entry evicted
+    uint32_t lost;      //suppressed but not reported in the window, collision
+    double ns;          //host ns per RxF_Is_Dup
+}RunTypeDef;
+
+static AdvTypeDef adv[BENCH_ADV_MAX];
+static BLE_PduTypeDef pdu_log[BENCH_RUN_MS/BENCH_ITV_MIN*BENCH_ADV_MAX];
+static uint32_t rnd = 1;
+static int failed;
+
+static uint32_t Rand(void)
+{
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd;
+}
+
+/*******************************************************************************
+* Function   :     	Pdu_Fill
+* Parameter  :     	BLE_PduTypeDef *pdu, const AdvTypeDef *a, uint32_t ms
+* Returns    :     	void
+* Description:      ADV_NONCONN_IND, manufacturer data with the payload version
+* Note:      :
+*******************************************************************************/
+static void Pdu_Fill(BLE_PduTypeDef *pdu, const AdvTypeDef *a, uint32_t ms)
+{
+    memset(pdu, 0, sizeof(*pdu));
+    pdu->hdr[0] = ADV_NONCONN_IND;
+    pdu->hdr[1] = LEN_BLE_ADDR + 12;
+    memcpy(pdu->addr, a->addr, LEN_BLE_ADDR);
+    pdu->data[0] = 2;
+    pdu->data[1] = BLE_GAP_AD_TYPE_FLAGS;
+    pdu->data[2] = 0x06;
+    pdu->data[3] = 8;
+    pdu->data[4] = BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA;
+    pdu->data[5] = 0x4C;
+    pdu->data[6] = 0x00;
+    memcpy(&pdu->data[7], &a->seq, 4);
+    pdu->len = 12;
+    pdu->time = ms*1000UL;
+}
+
+/*******************************************************************************
+* Function   :     	Fresh
+* Parameter  :     	uint8_t any, uint32_t seq, uint32_t time, last report
+*                   const AdvTypeDef *a, uint32_t ms
+* Returns    :     	uint8_t, 1: this payload was reported within the window
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t Fresh(uint8_t any, uint32_t seq, uint32_t time, const AdvTypeDef *a, uint32_t ms)
+{
+    return any && (seq == a->seq) && ((ms - time) < BENCH_WINDOW_MS);
+}
+
+/*******************************************************************************
+* Function   :     	Run
+* Parameter  :     	uint16_t n, advertisers. uint32_t heard, per 1000 events
+*                   RunTypeDef *r
+* Returns    :     	void
+* Description:      BENCH_RUN_MS of advertising, each event heard or not, PDUs
+*                   in time order to RxF_Is_Dup and to an exact filter. then
+*                   the same PDUs again, timed
+* Note:      :      heard < 1000: the scanner listens part time (rx windows)
+*******************************************************************************/
+static void Run(uint16_t n, uint32_t heard, RunTypeDef *r)
+{
+    BLE_PduTypeDef *pdu;
+    AdvTypeDef *a;
+    struct timespec t0;
+    struct timespec t1;
+    uint32_t ms;
+    uint32_t p;
+    uint32_t sum = 0;
+    uint16_t i;
+    uint8_t k;
+
+    memset(r, 0, sizeof(*r));
+    rnd = 12345;
+    for(i = 0; i < n; i++){
+        for(k = 0; k < LEN_BLE_ADDR; k++) adv[i].addr[k] = (uint8_t)Rand();
+        adv[i].itv = BENCH_ITV_MIN + Rand() % (BENCH_ITV_MAX - BENCH_ITV_MIN + 1);
+        adv[i].next = Rand() % adv[i].itv;
+        adv[i].seq = Rand();
+        adv[i].dup_any = 0;
+        adv[i].rep_any = 0;
+    }
+    RxF_Set_DupWindow(BENCH_WINDOW_MS);
+
+    for(ms = 0; ms < BENCH_RUN_MS; ms++){
+        for(i = 0; i < n; i++){
+            if(adv[i].next != ms) continue;
+            adv[i].next = ms + adv[i].itv + Rand() % 11;    //advDelay 0..10ms
+            if((Rand() % BENCH_DATA_MS) < adv[i].itv) adv[i].seq++;
+            if((Rand() % 1000) >= heard) continue;
+
+            a = &adv[i];
+            if(!Fresh(a->dup_any, a->dup_seq, a->dup_time, a, ms)){
+                a->dup_any = 1;
+                a->dup_seq = a->seq;
+                a->dup_time = ms;
+                r->ideal++;
+            }
+
+            pdu = &pdu_log[r->pdu++];
+            Pdu_Fill(pdu, a, ms);
+            if(RxF_Is_Dup(pdu)){
+                if(!Fresh(a->rep_any, a->rep_seq, a->rep_time, a, ms)) r->lost++;
+            }else{
+                if(Fresh(a->rep_any, a->rep_seq, a->rep_time, a, ms) &&
+                   ((ms - a->rep_time) < BENCH_WINDOW_MS - BENCH_EARLY_MS)) r->again++;
+                a->rep_any = 1;
+                a->rep_seq = a->seq;
+                a->rep_time = ms;
+                r->rep++;
+            }
+        }
+    }
+
+    //same PDUs again for the time, the table starts empty as before
+    RxF_Set_DupWindow(BENCH_WINDOW_MS);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(p = 0; p < r->pdu; p++) sum += RxF_Is_Dup(&pdu_log[p]);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    r->ns = ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec)) / r->pdu;
+    if(sum != r->pdu - r->rep){
+        printf("timed pass differs from the first pass\n");
+        failed = 1;
+    }
+}
+
+/*******************************************************************************
+* Function   :     	Check
+* Parameter  :     	const char *what, int ok
+* Returns    :     	void
+* Description:
+* Note:      :
+*******************************************************************************/
+static void Check(const char *what, int ok)
+{
+    printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+    if(!ok) failed = 1;
+}
+
+/*******************************************************************************
+* Function   :     	Test_Seen
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      RxF_Is_Seen does not remember: a PDU lost to a full ring is
+*                   reported on its next copy
+* Note:      :
+*******************************************************************************/
+static void Test_Seen(void)
+{
+    BLE_PduTypeDef pdu;
+
+    rnd = 99;
+    adv[0].seq = 1;
+    memset(adv[0].addr, 0x5A, LEN_BLE_ADDR);
+    RxF_Set_DupWindow(BENCH_WINDOW_MS);
+
+    Pdu_Fill(&pdu, &adv[0], 10);
+    Check("seen: new PDU is not seen", !RxF_Is_Seen(&pdu));
+    Pdu_Fill(&pdu, &adv[0], 20);
+    Check("seen: its next copy is reported", !RxF_Is_Dup(&pdu));
+    Pdu_Fill(&pdu, &adv[0], 30);
+    Check("seen: then it is seen and a dup", RxF_Is_Seen(&pdu) && RxF_Is_Dup(&pdu));
+    Pdu_Fill(&pdu, &adv[0], 20 + BENCH_WINDOW_MS);
+    Check("dup: reported again after the window", !RxF_Is_Dup(&pdu));
+}
+
+int main(void)
+{
+    static const uint16_t num[] = {50, 100, 300, 1000};
+    static const uint32_t heard[] = {1000, 125};
+    RunTypeDef r;
+    uint8_t i;
+    uint8_t k;
+    uint32_t lost = 0;
+
+    Test_Seen();
+
+    printf("\nRxF dup table %u x %u = %u entries, %u bytes, window %lums, %lus run\n",
+           RXF_DUP_SETS, RXF_DUP_WAYS, RXF_DUP_SETS*RXF_DUP_WAYS,
+           (unsigned)(RXF_DUP_SETS*RXF_DUP_WAYS*6), (unsigned long)BENCH_WINDOW_MS, BENCH_RUN_MS/1000);
+    printf("interval %u..%ums, payload change every %ums on average\n", BENCH_ITV_MIN, BENCH_ITV_MAX, BENCH_DATA_MS);
+    printf("exact: reports of a filter with one entry per advertiser\n");
+    printf("again: reported twice in the window, its entry was evicted\n");
+    printf("lost:  suppressed though not reported in the window (collision)\n");
+    printf("advs heard%% |   PDUs  exact | reports  again %%  lost | ns/lookup\n");
+
+    for(k = 0; k < sizeof(heard)/sizeof(heard[0]); k++){
+        for(i = 0; i < sizeof(num)/sizeof(num[0]); i++){
+            Run(num[i], heard[k], &r);
+            printf("%4u %6.1f | %6u %6u | %7u  %7.1f  %4u | %9.1f\n", num[i], heard[k]/10.0,
+                   r.pdu, r.ideal, r.rep, 100.0*r.again/r.rep, r.lost, r.ns);
+            lost += r.lost;
+        }
+    }
+    Check("no report lost to a fingerprint collision", lost == 0);
+    return failed;
+}
@@ -0,0 +1,186 @@
+/**
+  ******************************************************************************
+  * @file    :rxwin_sim.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :RxWin learned window against the fixed BLE_RX_TIMEOUT window,
+  *           one advertiser drifting against our own wakeups: capture rate
+  *           and receiver on time
+  ******************************************************************************
+  * build:  cc -O2 -Wall -Wextra -I. -I../../adv_trx/USER/inc -I../../FWLB/inc
+  *            -I../../DEVICE -o rxwin_sim rxwin_sim.c host.c
+  *            ../../adv_trx/USER/src/RxWin.c
+  * use:    rxwin_sim       exit code 1 if a check fails
+***/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Includes.h"
+
+#define SIM_EVENTS          2000    //13 minutes
+#define SIM_ITV_US          (BLE_ADV_INTERVAL*1000UL)   //our wakeups
+#define SIM_PDU_US          376     //ADV_NONCONN_IND, 31 byte payload, 1M
+#define SIM_START_US        (BLE_START_TIME*1000UL/HFCLK_1MS)
+
+typedef struct
+{
+    const char *name;
+    uint32_t itv_us;        //advertiser interval, its own clock
+    int32_t ppm;            //its clock against ours
+    uint32_t phase_us;      //first PDU after our first wakeup
+    uint32_t delay_us;      //advDelay 0..delay_us added to each interval
+    uint32_t loss;          //PDUs lost in the air, per 1000
+}ScenTypeDef;
+
+typedef struct
+{
+    uint32_t hits;
+    uint64_t rx_us;
+}WinTypeDef;
+
+static uint32_t rnd = 1;
+static int failed;
+
+static uint32_t Rand(void)
+{
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd;
+}
+
+/*******************************************************************************
+* Function   :     	Arrival
+* Parameter  :     	double open, double close, absolute us. const double *pdu
+*                   uint32_t cnt, PDU ends in time order
+* Returns    :     	double, first PDU fully inside the window, 0: none
+* Description:
+* Note:      :
+*******************************************************************************/
+static double Arrival(double open, double close, const double *pdu, uint32_t cnt)
+{
+    uint32_t i;
+
+    for(i = 0; i < cnt; i++){
+        if(pdu[i] - SIM_PDU_US < open) continue;
+        if(pdu[i] > close) break;
+        return pdu[i];
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function   :     	Run
+* Parameter  :     	const ScenTypeDef *s, WinTypeDef *fix, WinTypeDef *learn
+* Returns    :     	void
+* Description:      SIM_EVENTS wakeups, each opens one fixed and one learned
+*                   window over the same PDUs
+* Note:      :      the learned window is RxW_Next/RxW_Hit/RxW_End as in BLE_Event
+*******************************************************************************/
+static void Run(const ScenTypeDef *s, WinTypeDef *fix, WinTypeDef *learn)
+{
+    static double pdu[64];
+    const RxW_StatTypeDef *stat = RxW_Get_Stat();
+    uint32_t hits0 = stat->hits;
+    uint32_t rx0 = stat->rx_us;
+    uint64_t rx_sum = 0;
+    double itv = s->itv_us * (1.0 + s->ppm * 1e-6);
+    double next = s->phase_us;  //advertiser event
+    double adv;
+    double wake;
+    double at;
+    uint32_t start;
+    uint32_t timeout;
+    uint32_t cnt;
+    uint32_t n;
+
+    memset(fix, 0, sizeof(*fix));
+    memset(learn, 0, sizeof(*learn));
+    rnd = 7;
+    RxW_Reset();
+
+    for(n = 0; n < SIM_EVENTS; n++){
+        wake = (double)n * SIM_ITV_US;
+
+        //PDUs that end within reach of this wakeup
+        while(next + SIM_PDU_US < wake) next += itv + Rand() % (s->delay_us + 1);
+        cnt = 0;
+        for(adv = next; (adv < wake + SIM_START_US + BLE_RX_TIMEOUT) && (cnt < 64); adv += itv + Rand() % (s->delay_us + 1)){
+            if((Rand() % 1000) >= s->loss) pdu[cnt++] = adv + SIM_PDU_US;
+        }
+
+        at = Arrival(wake + SIM_START_US, wake + SIM_START_US + BLE_RX_TIMEOUT, pdu, cnt);
+        if(at != 0){
+            fix->hits++;
+            fix->rx_us += (uint64_t)(at - wake - SIM_START_US);
+        }else{
+            fix->rx_us += BLE_RX_TIMEOUT;
+        }
+
+        RxW_Next(&start, &timeout);
+        at = Arrival(wake + start, wake + start + timeout, pdu, cnt);
+        if(at != 0) RxW_Hit((uint32_t)(at - wake));
+        RxW_End();
+
+        //rx_us is 32 bits, add it up per event
+        rx_sum += (uint32_t)(stat->rx_us - rx0);
+        rx0 = stat->rx_us;
+    }
+    learn->hits = stat->hits - hits0;
+    learn->rx_us = rx_sum;
+}
+
+/*******************************************************************************
+* Function   :     	Check
+* Parameter  :     	const char *what, int ok
+* Returns    :     	void
+* Description:
+* Note:      :
+*******************************************************************************/
+static void Check(const char *what, int ok)
+{
+    printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+    if(!ok) failed = 1;
+}
+
+int main(void)
+{
+    static const ScenTypeDef scen[] = {
+        //same firmware: BLE_ADV_INTERVAL, no advDelay
+        {"peer, xtal +20ppm",          SIM_ITV_US,     20, 20000,     0, 100},
+        {"peer, xtal -20ppm, 30% lost", SIM_ITV_US,   -20, 20000,     0, 300},
+        {"peer, rc +0.2%",             SIM_ITV_US,   2000, 10000,     0, 100},
+        {"peer, rc -1%",               SIM_ITV_US, -10000, 45000,     0, 100},
+        //advDelay 0..10ms per event
+        {"adv 400ms",                  400000,         20, 20000, 10000, 100},
+        {"adv 395ms",                  395000,         20, 20000, 10000, 100},
+        {"adv 100ms",                  100000,         20, 20000, 10000, 100},
+        {"adv 1000ms",                1000000,         20, 20000, 10000, 100},
+    };
+    WinTypeDef f;
+    WinTypeDef l;
+    uint8_t i;
+    uint8_t worse = 0;
+    uint8_t fewer = 0;
+
+    printf("our wakeups every %lums, fixed window %luus from %luus, %u events\n",
+           SIM_ITV_US/1000, (unsigned long)BLE_RX_TIMEOUT, (unsigned long)SIM_START_US, SIM_EVENTS);
+    printf("capture: wakeups with a PDU. rx: receiver on per wakeup\n");
+    printf("%-32s | fixed capture%%  rx us | learned capture%%  rx us | us per PDU fixed learned\n", "advertiser");
+
+    for(i = 0; i < sizeof(scen)/sizeof(scen[0]); i++){
+        Run(&scen[i], &f, &l);
+        printf("%-32s | %14.1f %6.0f | %16.1f %6.0f | %16.0f %7.0f\n", scen[i].name,
+               100.0*f.hits/SIM_EVENTS, (double)f.rx_us/SIM_EVENTS,
+               100.0*l.hits/SIM_EVENTS, (double)l.rx_us/SIM_EVENTS,
+               f.hits ? (double)f.rx_us/f.hits : 0.0, l.hits ? (double)l.rx_us/l.hits : 0.0);
+        //energy per captured PDU no worse than the fixed window
+        if(l.hits && f.hits && ((double)l.rx_us/l.hits > 1.05*f.rx_us/f.hits)) worse++;
+        if(l.hits < 0.9*f.hits) fewer++;
+    }
+    Check("learned window: rx time per PDU <= fixed window", worse == 0);
+    Check("learned window: capture >= 90% of fixed window", fewer == 0);
+    return failed;
+}
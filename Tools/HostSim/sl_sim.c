@@ -0,0 +1,401 @@
+/**
+  ******************************************************************************
+  * @file    :sl_sim.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :ScanLog.c on the host flash image: rx stamps and marks, the us
+  *           wrap, ring wraparound, power cut at every flash operation, flash
+  *           cost per record
+  ******************************************************************************
+  * build:  cc -O2 -Wall -Wextra -Wno-int-to-pointer-cast -I.
+  *            -I../../adv_trx/USER/inc -I../../FWLB/inc -I../../DEVICE
+  *            -DSL_BASE=0x1000E800UL -o sl_sim sl_sim.c host.c
+  *            ../../adv_trx/USER/src/ScanLog.c ../../FWLB/src/cx32l003_crc.c
+  * use:    sl_sim          exit code 1 if a check fails
+***/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Includes.h"
+#include "cx32l003_rcc.h"
+
+#define SIM_REC_MAX         20000   //records put per run
+#define SIM_CUT_RECS        300     //records put in each power cut run
+#define SIM_LOG_MAX         (SL_SECTORS*FLASH_SECTOR_SIZE/sizeof(SL_RecordTypeDef))
+#define SIM_NO_MS           0xFFFFFFFFUL
+
+typedef struct
+{
+    uint32_t id;        //put order, addr[0..3] of a PDU record
+    uint32_t ms;        //ms since boot from the last mark, SIM_NO_MS: no mark
+    uint8_t mark;       //SL_LEN_BOOT, SL_LEN_CLOCK, 0: PDU
+}LogTypeDef;
+
+static uint32_t sim_ms;             //TK_Get_Ms
+static uint32_t sim_us0;            //TB_Get_Us at sim_ms 0
+static uint32_t rx_ms[SIM_REC_MAX]; //sim_ms at rx, per id
+static LogTypeDef log_rd[SIM_LOG_MAX];
+static uint32_t uart_bytes;
+static uint32_t rnd = 1;
+static int failed;
+
+uint32_t TK_Get_Ms(void)
+{
+    return sim_ms;
+}
+
+uint32_t TB_Get_Us(void)
+{
+    return sim_us0 + sim_ms*1000UL;     //wraps after 71 min, as on the chip
+}
+
+//SL_Dump
+uint8_t Uart_Put(const char *data, uint16_t len)
+{
+    (void)data;
+    uart_bytes += len;
+    return 1;
+}
+
+void Uart_Flush(void)
+{
+}
+
+//CRC_DeInit, not used here
+void RCC_PeriphResetCmd(RCC_TypeDef *RCCx, uint32_t Periph, FunctionalState NewState)
+{
+    (void)RCCx;
+    (void)Periph;
+    (void)NewState;
+}
+
+static uint32_t Rand(void)
+{
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd;
+}
+
+/*******************************************************************************
+* Function   :     	Check
+* Parameter  :     	const char *what, int ok
+* Returns    :     	void
+* Description:
+* Note:      :
+*******************************************************************************/
+static void Check(const char *what, int ok)
+{
+    printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+    if(!ok) failed = 1;
+}
+
+/*******************************************************************************
+* Function   :     	Boot
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      power-up: both clocks start over, SL_Init
+* Note:      :      TB_Get_Us starts anywhere
+*******************************************************************************/
+static void Boot(void)
+{
+    sim_ms = 0;
+    sim_us0 = Rand();
+    SL_Init();
+}
+
+/*******************************************************************************
+* Function   :     	Put
+* Parameter  :     	uint32_t id
+* Returns    :     	uint8_t, SL_Put result
+* Description:      a PDU received now, id in its address
+* Note:      :
+*******************************************************************************/
+static uint8_t Put(uint32_t id)
+{
+    BLE_PduTypeDef pdu;
+
+    memset(&pdu, 0, sizeof(pdu));
+    pdu.hdr[0] = ADV_NONCONN_IND;
+    memcpy(pdu.addr, &id, 4);
+    pdu.data[0] = 2;
+    pdu.data[1] = BLE_GAP_AD_TYPE_FLAGS;
+    pdu.data[2] = 0x06;
+    pdu.len = 3;
+    pdu.time = TB_Get_Us();
+    rx_ms[id % SIM_REC_MAX] = sim_ms;
+    return SL_Put(&pdu);
+}
+
+/*******************************************************************************
+* Function   :     	Read_Log
+* Parameter  :     	void
+* Returns    :     	uint32_t, records in log_rd, oldest first
+* Description:      SL_Iter over the flash, PDU records timed from the last
+*                   mark as a host decoder would
+* Note:      :
+*******************************************************************************/
+static uint32_t Read_Log(void)
+{
+    SL_IterTypeDef it;
+    const SL_RecordTypeDef *rec;
+    uint32_t mark_ms = SIM_NO_MS;
+    uint32_t mark_us = 0;
+    uint32_t n = 0;
+
+    SL_Iter_Init(&it);
+    while(((rec = SL_Iter_Next(&it)) != 0) && (n < SIM_LOG_MAX))
+    {
+        if(rec->type == SL_TYPE_MARK){
+            memcpy(&mark_ms, rec->addr, 4);
+            mark_us = rec->us;
+            log_rd[n].id = 0;
+            log_rd[n].ms = mark_ms;
+            log_rd[n].mark = rec->len;
+        }else{
+            memcpy(&log_rd[n].id, rec->addr, 4);
+            log_rd[n].ms = (mark_ms == SIM_NO_MS) ? SIM_NO_MS : mark_ms + (int32_t)(rec->us - mark_us)/1000;
+            log_rd[n].mark = 0;
+        }
+        n++;
+    }
+    return n;
+}
+
+/*******************************************************************************
+* Function   :     	Test_Stamp
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      a boot mark per power-up, records timed at rx, not when
+*                   SL_Poll got to them, across the us wrap and reboots
+* Note:      :
+*******************************************************************************/
+static void Test_Stamp(void)
+{
+    uint32_t n;
+    uint32_t i;
+    uint32_t id = 0;
+    uint32_t boots = 0;
+    uint32_t clocks = 0;
+    uint32_t bad_ms = 0;
+
+    Host_Flash_Init();
+    Boot();
+    n = Read_Log();
+    Check("boot: blank area formats, one boot mark", (n == 1) && (log_rd[0].mark == SL_LEN_BOOT) && (log_rd[0].ms == 0));
+
+    //drained 300ms after rx
+    for(i = 0; i < 5; i++){
+        sim_ms += 50;
+        Put(id++);
+    }
+    sim_ms += 300;
+    SL_Flush();
+    //an hour and more between records: the us stamp wraps in between
+    for(i = 0; i < 6; i++){
+        sim_ms += 50*60000UL;
+        Put(id++);
+        sim_ms += 10;
+        Put(id++);
+        SL_Flush();
+    }
+    sim_ms += 3*3600000UL;
+    Put(id++);
+    SL_Flush();
+    //reboot, more records
+    Boot();
+    for(i = 0; i < 3; i++){
+        sim_ms += 1000;
+        Put(id++);
+    }
+    SL_Flush();
+
+    n = Read_Log();
+    for(i = 0; i < n; i++){
+        if(log_rd[i].mark == SL_LEN_BOOT) boots++;
+        else if(log_rd[i].mark == SL_LEN_CLOCK) clocks++;
+        else if(log_rd[i].ms != rx_ms[log_rd[i].id]) bad_ms++;
+    }
+    printf("stamp: %u records, %u boot and %u clock marks\n", n, boots, clocks);
+    Check("stamp: one boot mark per power-up", boots == 2);
+    Check("stamp: every record at its rx ms since boot", (n == id + boots + clocks) && (bad_ms == 0));
+    Check("stamp: clock marks only after SL_CLOCK_MS", clocks == 7);
+}
+
+/*******************************************************************************
+* Function   :     	Test_Ring
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      SIM_REC_MAX records through SL_Poll: the newest are kept in
+*                   order, none missing, sectors erased in turn
+* Note:      :      SL_Dump sends what SL_Iter reads
+*******************************************************************************/
+static void Test_Ring(void)
+{
+    uint32_t i;
+    uint32_t n;
+    uint32_t gaps = 0;
+    uint32_t lo = UINT32_MAX;
+    uint32_t hi = 0;
+    uint32_t e;
+    uint8_t s;
+
+    Host_Flash_Init();
+    Boot();
+    for(i = 0; i < SIM_REC_MAX; i++){
+        sim_ms += 100;
+        Put(i);
+        SL_Poll();
+    }
+    SL_Flush();
+
+    n = Read_Log();
+    for(i = 1; i < n; i++){
+        if(log_rd[i].mark || log_rd[i-1].mark) continue;
+        if(log_rd[i].id != log_rd[i-1].id + 1) gaps++;
+    }
+    for(s = 0; s < SL_SECTORS; s++){
+        e = host_flash_erase[(SL_BASE - HOST_FLASH_BASE)/FLASH_SECTOR_SIZE + s];
+        if(e < lo) lo = e;
+        if(e > hi) hi = e;
+    }
+    printf("ring: %u records kept of %u, erases per sector %u..%u\n", n, SIM_REC_MAX, lo, hi);
+    Check("ring: newest record last, the rest in order", (n > 0) && (log_rd[n-1].id == SIM_REC_MAX - 1) && (gaps == 0));
+    Check("ring: keeps SL_SECTORS-1 sectors at least", n >= (SL_SECTORS - 1)*((FLASH_SECTOR_SIZE - 4)/(4 + SL_BATCH*16)*SL_BATCH));
+    Check("ring: sectors erased in turn", hi <= lo + 1);
+    Check("ring: no drops, no program errors", (SL_Get_Drop() == 0) && (host_flash_err == 0));
+
+    uart_bytes = 0;
+    SL_Dump();
+    Check("dump: every record sent", uart_bytes == n*sizeof(SL_RecordTypeDef));
+}
+
+/*******************************************************************************
+* Function   :     	Test_Cut
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      power cut at the n-th flash operation, for every n until
+*                   the records run out first. after the next boot: the records
+*                   read are in order with no gap, up to the last batch written
+*                   whole at least, then the boot mark, and logging goes on
+* Note:      :
+*******************************************************************************/
+static void Test_Cut(void)
+{
+    static uint32_t cut;
+    static uint32_t bad;
+    static uint32_t lost;
+    static uint32_t dead;
+    static uint32_t put;
+    static uint32_t done;       //records of the batches written whole
+    uint32_t n;
+    uint32_t i;
+    uint32_t b;
+    uint32_t last;
+    uint32_t gaps;
+
+    for(cut = 1; ; cut++){
+        Host_Flash_Init();
+        rnd = 5;
+        put = 0;
+        done = 0;
+        Boot();
+
+        host_flash_cut = cut;
+        if(setjmp(host_flash_jmp) == 0){
+            while(put < SIM_CUT_RECS){
+                sim_ms += 100;
+                Put(put++);
+                SL_Poll();
+                if(put % SL_BATCH == 0) done = put;
+            }
+            break;      //all written before the cut
+        }
+
+        Boot();
+        for(i = 0; i < SL_BATCH; i++){
+            sim_ms += 100;
+            Put(SIM_CUT_RECS + i);
+        }
+        SL_Flush();
+
+        //last boot mark: the records before it are from before the cut
+        n = Read_Log();
+        for(b = n; (b > 0) && (log_rd[b-1].mark != SL_LEN_BOOT); b--);
+        last = 0;
+        gaps = 0;
+        for(i = 0; i + 1 < b; i++){
+            if(log_rd[i].mark) continue;
+            if(log_rd[i].id >= put) bad++;
+            if(last && (log_rd[i].id != last)) gaps++;
+            last = log_rd[i].id + 1;
+        }
+        if(gaps) bad++;
+        if(done && (last < done)) lost++;
+        if((b == 0) || (n != b + SL_BATCH) || (log_rd[n-1].id != SIM_CUT_RECS + SL_BATCH - 1)) dead++;
+    }
+    printf("cut: power lost at flash operation 1..%u of %u records\n", cut - 1, SIM_CUT_RECS);
+    Check("cut: records read are in order, no gap", bad == 0);
+    Check("cut: batches written before the cut kept", lost == 0);
+    Check("cut: boot mark and new records after the cut", dead == 0);
+}
+
+/*******************************************************************************
+* Function   :     	Bench_Flash
+* Parameter  :     	uint8_t every, SL_Flush after this many records, 0: SL_Poll
+* Returns    :     	void
+* Description:      SIM_REC_MAX records: flash words and erases per record,
+*                   records the ring holds
+* Note:      :
+*******************************************************************************/
+static void Bench_Flash(uint8_t every)
+{
+    uint32_t erases = 0;
+    uint32_t i;
+    uint32_t n;
+    uint8_t s;
+
+    Host_Flash_Init();
+    Boot();
+    host_flash_prog = 0;
+    for(i = 0; i < SIM_REC_MAX; i++){
+        sim_ms += 100;
+        Put(i);
+        if(every && ((i + 1) % every == 0)) SL_Flush();
+        else SL_Poll();
+    }
+    SL_Flush();
+    for(s = 0; s < SL_SECTORS; s++){
+        erases += host_flash_erase[(SL_BASE - HOST_FLASH_BASE)/FLASH_SECTOR_SIZE + s];
+    }
+    n = Read_Log();
+    printf("%13u | %9.2f | %12.3f | %12u\n", every ? every : SL_BATCH,
+           4.0*host_flash_prog/SIM_REC_MAX, 1000.0*erases/SIM_REC_MAX, n);
+}
+
+int main(void)
+{
+    uint32_t boots;
+
+    Test_Stamp();
+    Test_Ring();
+    Test_Cut();
+
+    printf("\nflash cost, %u records of %u bytes, %u sectors\n", SIM_REC_MAX,
+           (unsigned)sizeof(SL_RecordTypeDef), SL_SECTORS);
+    printf("records/write | bytes/rec | erases/1000 | ring records\n");
+    Bench_Flash(0);
+    Bench_Flash(4);
+    Bench_Flash(1);
+
+    //a reset loop: a boot mark each, the ring fills with marks only
+    Host_Flash_Init();
+    Boot();
+    host_flash_prog = 0;
+    for(boots = 0; boots < 1000; boots++) Boot();
+    printf("boot mark: %.1f bytes of flash per power-up\n", 4.0*host_flash_prog/1000);
+    Check("boot: one mark per power-up, no program errors", host_flash_err == 0);
+    return failed;
+}
@@ -0,0 +1,294 @@
+/**
+  ******************************************************************************
+  * @file    :spi_bench.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :SPI_Async_* against the blocking SPI calls on the mock SPI of
+  *           host.c: same bytes on the bus, queueing, time and CPU load
+  ******************************************************************************
+  * build:  cc -Wall -Wextra -I. -I../../adv_trx/USER/inc -I../../FWLB/inc
+  *            -I../../DEVICE -o spi_bench spi_bench.c host.c
+  *            ../../adv_trx/USER/src/Spi.c
+  * use:    spi_bench       exit code 1 if a check fails
+***/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Includes.h"
+
+#define BENCH_HCLK_MHZ      24      //SYSCLK_BURST_HZ, BLE_Start runs there
+
+static uint8_t adv[LEN_DATA];
+static uint8_t hdr[2] = {ADV_NONCONN_IND, LEN_DATA+LEN_BLE_ADDR};
+static uint8_t clr[2] = {0xFF, 0x80};
+static uint8_t tmo[3] = {0x50, 0xC3, 0x00};
+
+static uint16_t ref_log[HOST_SPI_LOG_MAX];
+static uint32_t ref_len;
+static int failed;
+
+typedef struct
+{
+    uint64_t cyc;
+    uint64_t busy;
+    uint64_t sleep;
+    uint32_t irq;
+}BenchTypeDef;
+
+/*******************************************************************************
+* Function   :     	Bench_Start
+* Parameter  :     	uint8_t bank, selected before
+* Returns    :     	void
+* Description:      idle SPI, bank selected, counters 0
+* Note:      :
+*******************************************************************************/
+static void Bench_Start(uint8_t bank)
+{
+    SPI_Async_Wait();
+    SPI_Reset_Bank();
+    SPI_Select_Bank(bank);
+    Host_Reset();
+}
+
+static void Bench_Stop(BenchTypeDef *b)
+{
+    b->cyc = host_cyc;
+    b->busy = host_busy;
+    b->sleep = host_sleep;
+    b->irq = host_irq_cnt;
+}
+
+/*******************************************************************************
+* Function   :     	Stage_Write
+* Parameter  :     	uint8_t reg, uint8_t *buf, uint8_t len
+* Returns    :     	void
+* Description:      as BLE_Stage_Write in MG127.c, BLE_STAGE_ASYNC 1
+* Note:      :
+*******************************************************************************/
+static void Stage_Write(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+    SPI_XferTypeDef xfer;
+
+    xfer.reg = reg;
+    xfer.dir = SPI_DIR_WRITE;
+    xfer.len = len;
+    xfer.buf = buf;
+    xfer.bank = BANK_56;
+    xfer.done = 0;
+    if(!SPI_Async_Submit(&xfer)){
+        SPI_Select_Bank(BANK_56);
+        SPI_Write_Buffer(reg, buf, len);
+    }
+}
+
+/*******************************************************************************
+* Function   :     	Commit_Blocking
+* Parameter  :     	uint32_t work, cycles of SPI free work
+* Returns    :     	void
+* Description:      BLE_Start from BLE_Stage_Commit to BLE_Set_TimeOut, all
+*                   blocking: FIFO, header, INT_FLAG, work, timeout
+* Note:      :
+*******************************************************************************/
+static void Commit_Blocking(uint32_t work)
+{
+    SPI_Select_Bank(BANK_56);
+    SPI_Write_Buffer(W_TX_PAYLOAD, adv, LEN_DATA);
+    SPI_Write_Buffer(ADV_HDR_TX, hdr, 2);
+    SPI_Write_Buffer(INT_FLAG, clr, 2);
+    Host_Cpu(work);
+    SPI_Select_Bank(BANK_56);
+    SPI_Write_Buffer(TIMEOUT, tmo, 3);
+}
+
+/*******************************************************************************
+* Function   :     	Commit_Async
+* Parameter  :     	uint32_t work, cycles of SPI free work
+* Returns    :     	void
+* Description:      same with the three writes queued, BLE_STAGE_ASYNC 1
+* Note:      :
+*******************************************************************************/
+static void Commit_Async(uint32_t work)
+{
+    Stage_Write(W_TX_PAYLOAD, adv, LEN_DATA);
+    Stage_Write(ADV_HDR_TX, hdr, 2);
+    Stage_Write(INT_FLAG, clr, 2);
+    Host_Cpu(work);
+    SPI_Select_Bank(BANK_56);
+    SPI_Write_Buffer(TIMEOUT, tmo, 3);
+}
+
+/*******************************************************************************
+* Function   :     	Check
+* Parameter  :     	const char *what, int ok
+* Returns    :     	void
+* Description:
+* Note:      :
+*******************************************************************************/
+static void Check(const char *what, int ok)
+{
+    printf("%-48s %s\n", what, ok ? "ok" : "FAILED");
+    if(!ok) failed = 1;
+}
+
+static int Log_Same(void)
+{
+    return (host_spi_len == ref_len) && !memcmp(host_spi_log, ref_log, ref_len*sizeof(ref_log[0]));
+}
+
+static double Us(uint64_t cyc)
+{
+    return (double)cyc / BENCH_HCLK_MHZ;
+}
+
+/*******************************************************************************
+* Function   :     	Test_Bus
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      queued and blocking commit put the same frames on the bus,
+*                   bank select included, and nothing collides
+* Note:      :
+*******************************************************************************/
+static void Test_Bus(void)
+{
+    SPI_XferTypeDef xfer;
+    uint8_t n;
+
+    Bench_Start(BANK_53);   //as after BLE_Get_RSSI
+    Commit_Blocking(0);
+    memcpy(ref_log, host_spi_log, host_spi_len*sizeof(ref_log[0]));
+    ref_len = host_spi_len;
+
+    Bench_Start(BANK_53);
+    Commit_Async(0);
+    Check("bus: async commit = blocking commit, from BANK_53", Log_Same() && !host_spi_err);
+
+    Bench_Start(BANK_56);
+    Commit_Blocking(0);
+    memcpy(ref_log, host_spi_log, host_spi_len*sizeof(ref_log[0]));
+    ref_len = host_spi_len;
+
+    Bench_Start(BANK_56);
+    Commit_Async(0);
+    Check("bus: async commit = blocking commit, from BANK_56", Log_Same() && !host_spi_err);
+
+    //queue holds SPI_ASYNC_DEPTH-1, the rest is refused
+    Bench_Start(BANK_56);
+    xfer.reg = W_TX_PAYLOAD;
+    xfer.dir = SPI_DIR_WRITE;
+    xfer.len = LEN_DATA;
+    xfer.buf = adv;
+    xfer.bank = 0;
+    xfer.done = 0;
+    for(n = 0; SPI_Async_Submit(&xfer); n++);
+    SPI_Async_Wait();
+    Check("queue: accepts SPI_ASYNC_DEPTH-1 transfers", (n == SPI_ASYNC_DEPTH-1) && !host_spi_err);
+    Check("queue: all bytes out", host_spi_len == n*(1 + LEN_DATA + 1));
+}
+
+/*******************************************************************************
+* Function   :     	Bench_Commit
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      BLE_Start commit + SPI free work, blocking vs queued
+* Note:      :      busy: thread + handlers, the CPU cannot sleep then
+*******************************************************************************/
+static void Bench_Commit(void)
+{
+    static const uint32_t div[] = {4, 8, 16, 32};
+    static const uint32_t work[] = {0, 240, 1200};
+    BenchTypeDef b;
+    BenchTypeDef a;
+    uint8_t i;
+    uint8_t k;
+
+    printf("\nBLE_Start commit, %d+%d+%d bytes + timeout, HCLK %dMHz, handler %u cycles\n",
+           LEN_DATA, 2, 2, BENCH_HCLK_MHZ, host_irq_cyc);
+    printf("spi div  work(us) | blocking us  busy us | async us  busy us  sleep us  irqs\n");
+
+    for(i = 0; i < sizeof(div)/sizeof(div[0]); i++)
+    {
+        host_spi_div = div[i];
+        for(k = 0; k < sizeof(work)/sizeof(work[0]); k++)
+        {
+            Bench_Start(BANK_56);
+            Commit_Blocking(work[k]);
+            Bench_Stop(&b);
+
+            Bench_Start(BANK_56);
+            Commit_Async(work[k]);
+            SPI_Async_Wait();
+            Bench_Stop(&a);
+
+            printf("%7u  %8.1f | %11.1f  %7.1f | %8.1f  %7.1f  %8.1f  %4u\n",
+                   div[i], Us(work[k]), Us(b.cyc), Us(b.busy), Us(a.cyc), Us(a.busy), Us(a.sleep), a.irq);
+        }
+    }
+    host_spi_div = 4;
+}
+
+/*******************************************************************************
+* Function   :     	Bench_Stream
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      throughput, 100 FIFO writes back to back
+* Note:      :      async keeps the queue full, the thread sleeps in between
+*******************************************************************************/
+static void Bench_Stream(void)
+{
+    static const uint32_t div[] = {4, 8, 16, 32};
+    SPI_XferTypeDef xfer;
+    BenchTypeDef b;
+    BenchTypeDef a;
+    uint8_t i;
+    uint8_t n;
+    uint32_t bytes = 100*(1 + LEN_DATA);
+
+    printf("\n100 x %d byte writes\n", LEN_DATA);
+    printf("spi div | blocking kB/s  busy %% | async kB/s  busy %%\n");
+
+    xfer.reg = W_TX_PAYLOAD;
+    xfer.dir = SPI_DIR_WRITE;
+    xfer.len = LEN_DATA;
+    xfer.buf = adv;
+    xfer.bank = BANK_56;
+    xfer.done = 0;
+
+    for(i = 0; i < sizeof(div)/sizeof(div[0]); i++)
+    {
+        host_spi_div = div[i];
+
+        Bench_Start(BANK_56);
+        for(n = 0; n < 100; n++) SPI_Write_Buffer(W_TX_PAYLOAD, adv, LEN_DATA);
+        Bench_Stop(&b);
+
+        Bench_Start(BANK_56);
+        for(n = 0; n < 100; n++){
+            while(!SPI_Async_Submit(&xfer)){
+                __disable_irq();
+                __WFI();
+                __enable_irq();
+            }
+        }
+        SPI_Async_Wait();
+        Bench_Stop(&a);
+
+        printf("%7u | %13.1f  %6.1f | %10.1f  %6.1f\n", div[i],
+               bytes*1000.0/Us(b.cyc), 100.0*b.busy/b.cyc, bytes*1000.0/Us(a.cyc), 100.0*a.busy/a.cyc);
+    }
+    host_spi_div = 4;
+}
+
+int main(void)
+{
+    uint8_t i;
+
+    for(i = 0; i < LEN_DATA; i++) adv[i] = i;
+    SPI_Csn_Init();
+
+    Test_Bus();
+    Bench_Commit();
+    Bench_Stream();
+    return failed;
+}
@@ -0,0 +1,236 @@
+/**
+  ******************************************************************************
+  * @file    :trace_decode.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :host decoder for the adv_trx binary trace (USER/inc/Trace.h)
+  ******************************************************************************
+  * build:  cc -o trace_decode trace_decode.c
+  * use:    trace_decode [capture.bin]      stdin if no file, e.g. a tty
+  *         stty -F /dev/ttyUSB0 19200 raw; trace_decode < /dev/ttyUSB0
+***/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../../adv_trx/USER/inc/Trace.h"
+
+#define FRAME_MAX           (1 + 3 + TR_ARG_MAX + 1)
+#define SL_TYPE_MARK        0xFF    //ScanLog.h
+#define SL_LEN_BOOT         0xFF
+
+static const char *state_name[] = {"IDLE", "SLEEP", "WAKEUP", "TRX"};  //MG127.c
+
+/*******************************************************************************
+* Function   :     	Le32
+* Parameter  :     	const uint8_t *p
+* Returns    :     	uint32_t
+* Description:      p[0..3], little endian
+* Note:      :
+*******************************************************************************/
+static uint32_t Le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*******************************************************************************
+* Function   :     	Cobs_Decode
+* Parameter  :     	const uint8_t *in, int len, uint8_t *out
+* Returns    :     	int, bytes in out, -1: bad frame
+* Description:      COBS decode one frame, delimiter already removed
+* Note:      :
+*******************************************************************************/
+static int Cobs_Decode(const uint8_t *in, int len, uint8_t *out)
+{
+    int pos = 0;
+    int n = 0;
+    uint8_t code;
+    int i;
+
+    while(pos < len)
+    {
+        code = in[pos++];
+        if(code == 0) return -1;
+        for(i = 1; i < code; i++){
+            if(pos >= len) return -1;
+            out[n++] = in[pos++];
+        }
+        if((code < 0xFF) && (pos < len)) out[n++] = 0;
+    }
+    return n;
+}
+
+/*******************************************************************************
+* Function   :     	Print_State
+* Parameter  :     	const uint8_t *arg, int len
+* Returns    :     	void
+* Description:
+* Note:      :
+*******************************************************************************/
+static void Print_State(const uint8_t *arg, int len)
+{
+    if(len < 1) return;
+    if(arg[0] < sizeof(state_name)/sizeof(state_name[0])){
+        printf(" from %s", state_name[arg[0]]);
+    }else{
+        printf(" from state %u", arg[0]);
+    }
+}
+
+/*******************************************************************************
+* Function   :     	Print_Frame
+* Parameter  :     	const uint8_t *raw, int len
+* Returns    :     	void
+* Description:      one decoded frame {id, ms[2], arg} as a text line
+* Note:      :      ms is 16 bit on the wire, extended here
+*******************************************************************************/
+static void Print_Frame(const uint8_t *raw, int len)
+{
+    static uint32_t ms_hi = 0;
+    static uint16_t ms_last = 0;
+    static uint32_t sl_ms;          //last scan log mark
+    static uint32_t sl_us;
+    static uint8_t sl_mark;
+    const uint8_t *arg = raw + 3;
+    int alen = len - 3;
+    uint16_t ms;
+    int i;
+
+    if(len < 3){
+        printf("short frame, %d bytes\n", len);
+        return;
+    }
+
+    ms = raw[1] | (raw[2] << 8);
+    if(ms < ms_last) ms_hi += 0x10000;
+    ms_last = ms;
+    printf("%10.3f  ", (ms_hi + ms) / 1000.0);
+
+    switch(raw[0])
+    {
+        case TR_ID_BOOT:
+            printf("BOOT");
+            ms_hi = 0;
+            break;
+        case TR_ID_CHIP:
+            printf("CHIP version=%02X", alen > 0 ? arg[0] : 0);
+            break;
+        case TR_ID_ADDR:
+            printf("ADDR");
+            for(i = alen - 1; i >= 0; i--) printf("%c%02X", (i == alen - 1) ? ' ' : ':', arg[i]);
+            break;
+        case TR_ID_EVT_START:
+            printf("EVT_START");
+            Print_State(arg, alen);
+            break;
+        case TR_ID_RX_WIN:
+            if(alen < 8) goto bad;
+            printf("RX_WIN start=%uus timeout=%uus", Le32(arg), Le32(arg + 4));
+            break;
+        case TR_ID_RX_HIT:
+            if(alen < 6) goto bad;
+            printf("RX_HIT offset=%uus rssi=%u type=%u", Le32(arg), arg[4], arg[5]);
+            break;
+        case TR_ID_EVT_END:
+            if(alen < 2) goto bad;
+            printf("EVT_END wanted=%u next=%s", arg[0], arg[1] ? "SLEEP" : "IDLE");
+            break;
+        case TR_ID_GUARD:
+            printf("GUARD");
+            Print_State(arg, alen);
+            break;
+        case TR_ID_PDU:
+            if(alen < 4) goto bad;
+            printf("PDU rssi=%u ch=%u:", arg[0], arg[1]);
+            for(i = 2; i < alen; i++) printf(" %02X", arg[i]);
+            break;
+        case TR_ID_UART_DROP:
+            if(alen < 4) goto bad;
+            printf("UART_DROP total=%u bytes", Le32(arg));
+            break;
+        case TR_ID_SCAN:    //SL_RecordTypeDef, stamped at rx, not at the frame time
+            if(alen < 16) goto bad;
+            if(arg[10] == SL_TYPE_MARK){
+                sl_us = Le32(arg);
+                sl_ms = Le32(arg + 4);
+                sl_mark = 1;
+                printf("SCAN %s at=%.3f us=%u", (arg[11] == SL_LEN_BOOT) ? "BOOT" : "CLOCK", sl_ms / 1000.0, sl_us);
+                break;
+            }
+            if(sl_mark){    //ms since boot from the last mark, the us wrap
+                printf("SCAN at=%.3f addr", (sl_ms + (int32_t)(Le32(arg) - sl_us) / 1000) / 1000.0);
+            }else{
+                printf("SCAN us=%u addr", Le32(arg));
+            }
+            for(i = 9; i >= 4; i--) printf("%c%02X", (i == 9) ? ' ' : ':', arg[i]);
+            printf(" type=%02X len=%u rssi=%u ch=%u hash=%04X",
+                   arg[10], arg[11], arg[12], arg[13], arg[14] | (arg[15] << 8));
+            break;
+        case TR_ID_CAL:
+            if(alen < 8) goto bad;
+            printf("CAL done=%u skipped=%u", Le32(arg), Le32(arg + 4));
+            break;
+        case TR_ID_WAKE:
+            if(alen < 8) goto bad;
+            printf("WAKE %s start=%uus", Le32(arg + 4) ? "warm" : "cold", Le32(arg));
+            break;
+        case TR_ID_IDLE:
+            if(alen < 8) goto bad;
+            printf("IDLE %s gap=%ums", Le32(arg + 4) ? "SLEEP" : "PWRDN", Le32(arg));
+            break;
+        default:
+            printf("id %u:", raw[0]);
+            for(i = 0; i < alen; i++) printf(" %02X", arg[i]);
+            break;
+    }
+    printf("\n");
+    return;
+
+bad:
+    printf("id %u, %d arg bytes, too short\n", raw[0], alen);
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    uint8_t frame[FRAME_MAX];
+    uint8_t raw[FRAME_MAX];
+    int len = 0;
+    int n;
+    int c;
+
+    if(argc > 1){
+        in = fopen(argv[1], "rb");
+        if(!in){
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    while((c = fgetc(in)) != EOF)
+    {
+        if(c != 0){
+            if(len < FRAME_MAX) frame[len] = (uint8_t)c;
+            len++;
+            continue;
+        }
+
+        if(len > FRAME_MAX){
+            printf("frame too long, %d bytes\n", len);  //lost sync, ASCII output?
+        }else if(len > 0){
+            n = Cobs_Decode(frame, len, raw);
+            if(n < 0){
+                printf("bad frame, %d bytes\n", len);
+            }else{
+                Print_Frame(raw, n);
+            }
+        }
+        len = 0;
+        fflush(stdout);
+    }
+
+    if(in != stdin) fclose(in);
+    return 0;
+}
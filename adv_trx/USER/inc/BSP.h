@@ -8,9 +8,15 @@
 #include "cx32l003_exti.h"
 #include "cx32l003_spi.h"
 #include "cx32l003_uart.h"
+#include "cx32l003_lpuart.h"
 #include "cx32l003_rtc.h"
+#include "cx32l003_lptimer.h"
+#include "cx32l003_syscon.h"
 #include "cx32l003_iwdt.h"
+#include "cx32l003_flash.h"
+#include "cx32l003_crc.h"
 #include "misc.h"
+#include "FastIo.h"
 
 #define      LED1_GPIO_PORT                      GPIOA
 #define      LED1_GPIO_PORT_PIN                  GPIO_Pin_1
@@ -27,17 +33,50 @@
 
 #define Hex2Ascii(data)  (data < 10)? ('0' + data) : ('A' + data - 10)
 
+#define SYSCLK_IDLE_HZ      4000000UL
+#define SYSCLK_BURST_HZ     24000000UL
+#define UART_BAUD           19200   //on both clocks
+#define UART_TX_SIZE        256     //TX ring, power of 2, holds UART_TX_SIZE-1
+#define UART_RX_SIZE        32      //RX ring for Uart_Get, power of 2
+
+/* log/command port. default UART0 on PD3/PD4: HIRC, nothing moves in deep sleep.
+   LOG_LPUART: commands also received on LPUART RX PA3, LIRC, low power mode,
+   works in deep sleep and wakes the MCU. with LPUART_TX_AF the log goes out
+   on LPUART too (UART_TX_DEEPSLEEP). MS1656: the LPUART TX pins PC5/PD2 are
+   the BLE SPI, leave LPUART_TX_AF off */
+//#define LOG_LPUART
+//#define LPUART_TX_AF            GPIO_AF_LPUART_TX_PD2
+#define LPUART_TX_PORT          GPIOD
+#define LPUART_TX_PIN           GPIO_Pin_2
+#define LPUART_TX_PIN_SOURCE    GPIO_PinSource2
+#define LPUART_BAUD             9600    //LIRC 38400 / LPUART_SCLK_DIV4
+
+#if defined(LOG_LPUART) && defined(LPUART_TX_AF)
+  #define UART_TX_DEEPSLEEP
+#endif
+#if defined(LOG_LPUART) && defined(BLE_DEBUG)
+  #error "LOG_LPUART: PA3 is LPUART RX, BLE_DEBUG drives it as NSS"
+#endif
+
 extern void BSP_Init(void);
+extern void SysClock_Burst_Enter(void);
+extern void SysClock_Burst_Exit(void);
+extern uint32_t SysClock_Get_Hz(void);
 extern void Delay_ms(uint16_t delayCnt);
+extern uint32_t Get_Time_ms(void);
 
-extern char KEY_GET(void);
-extern void LED_RED_ON(void);
-extern void LED_RED_OFF(void);
-extern void LED_GREEN_ON(void);
-extern void LED_GREEN_OFF(void);
+#define KEY_GET()           (!FIO_Get(KEY1_GPIO_PORT, KEY1_GPIO_PORT_PIN))
+#define LED_RED_ON()        FIO_Set(LED2_GPIO_PORT, LED2_GPIO_PORT_PIN)
+#define LED_RED_OFF()       FIO_Clr(LED2_GPIO_PORT, LED2_GPIO_PORT_PIN)
+#define LED_GREEN_ON()      FIO_Set(LED1_GPIO_PORT, LED1_GPIO_PORT_PIN)
+#define LED_GREEN_OFF()     FIO_Clr(LED1_GPIO_PORT, LED1_GPIO_PORT_PIN)
 
+extern uint8_t Uart_Put(const char *data, uint16_t len);
 extern void Uart_Send_Byte(char data);
 extern void Uart_Send_String(char *data);
+extern uint32_t Uart_Get_Drop(void);
+extern void Uart_Flush(void);
+extern uint8_t Uart_Get(uint8_t *data);
 
 
 #endif
@@ -9,10 +9,25 @@
 //0.5ms
 #define	BLE_START_TIME		(HFCLK_1MS/2)
 
-//50ms, max:0xffff=65,535 us
+//sleep clock, SLEEP_WAKEUP wake time unit
+#define LFCLK_1MS           32UL
+#define BLE_WAKE_NEVER      0xFFFFFFUL
+
+//adv event interval, BLE wakes itself. see BLE_Set_Interval()
+#define BLE_ADV_INTERVAL    400
+
+//50ms, max:0xffff=65,535 us. longest rx window, see RxWin.h
 #define BLE_RX_TIMEOUT      50000
 #define BLE_GUARD_TIME      (2UL*BLE_RX_TIMEOUT/1000)
 
+/* 1: BLE_Stage_Commit queues its writes (SPI_Async_Submit), BLE_Start runs
+   on meanwhile. at the /4 SPI clock a byte is 32 HCLK, less than one
+   SPI0COMB_IRQHandler: 148us instead of 68us, 98us of it CPU time, see
+   Tools/HostSim/spi_bench.c. less CPU time from /8 on */
+#ifndef BLE_STAGE_ASYNC
+#define BLE_STAGE_ASYNC     0
+#endif
+
 /* set BLE TX power
 0  -- -54 dBm
 1  -- -37 dBm
@@ -41,7 +56,34 @@
 
 #define BLE_TX_POWER		BLE_TX_POWER5dbm
 
+/* BLE_Mode_PwrUp always calibrates: the results cannot be read back, and no
+   datasheet says they survive BLE_Mode_PwrDn. a warm start (light sleep, see
+   BLE_RETAIN_MS) skips it unless the conditions of the last one drifted:
+   supply (BLE_Cal_Env), temperature (BLE_Cal_Env) or age.
+   defaults, KV_KEY_CAL_THR overrides. 0: off */
+#define BLE_CAL_VDD_MV      100     //supply drift, mV
+#define BLE_CAL_TEMP_C      10      //temperature drift, deg C
+#define BLE_CAL_MAX_MS      600000UL//age, ms
+
+/* idle between BLE_Start() calls: light sleep (3uA, registers, pins and
+   calibration kept, warm start) if the next start is expected within
+   BLE_RETAIN_MS, else power down (full BLE_Mode_PwrUp at the next start).
+   the expected gap is BLE_Set_NextStart() or the last measured one, none at
+   the first start. off until light sleep current and warm/cold start times
+   are measured on the target: TR_ID_IDLE and TR_ID_WAKE trace them.
+   BLE_Set_Retain() at run time */
+#ifndef BLE_RETAIN_MS
+#define BLE_RETAIN_MS       0       //ms, 0: always power down
+#endif
+
 /*-------------------------------BLE register---------------------------------*/
+//register bank select, write only. reg 0x00--0x3F are banked
+#define BANK_SEL      0x50
+
+#define BANK_51       0x51  //power control: 0x20 pwr up/down, 0x26 data rate, 0x1F chip ok
+#define BANK_53       0x53  //analog/rf trim: 0x04 rssi, 0x35 test mode, 0x37--0x39 pin config
+#define BANK_56       0x56  //BLE link registers below (CH_NO ... CHIP_OK)
+
 //set advertise channel number 37 38 39
 #define CH_NO         0x01
 /*
@@ -179,6 +221,7 @@
 extern void BLE_Init(void);
 extern void BLE_TRX(void);
 extern void BLE_Start(void);
+extern uint8_t ble_McuCanSleep(void);
 
 extern uint8_t txcnt;
 extern uint8_t rxcnt;
@@ -186,16 +229,50 @@ extern uint8_t rxcnt;
 #define LEN_BLE_ADDR 6
 #define LEN_DATA 31
 extern uint8_t adv_data[LEN_DATA];
-extern uint8_t rx_buf[39];
+
+//received adv PDU. hdr, addr, data in air order
+typedef struct
+{
+    uint8_t hdr[2];                 //pdu type, pdu length
+    uint8_t addr[LEN_BLE_ADDR];     //advA
+    uint8_t data[LEN_DATA];
+    uint8_t len;                    //bytes in data
+    uint8_t rssi;                   //1dB
+    uint8_t ch;                     //37.38.39
+    uint32_t time;                  //TB_Get_Us() at rx
+}BLE_PduTypeDef;
+
+//recalibration thresholds, KV_KEY_CAL_THR. 0: not checked
+typedef struct
+{
+    uint32_t max_ms;                //age
+    uint16_t vdd_mv;                //supply drift
+    uint8_t temp_c;                 //temperature drift
+    uint8_t rsv;
+}BLE_CalThrTypeDef;
 
 extern void BLE_Mode_PwrDn(void);
 extern void BLE_Mode_PwrUp(void);
 extern void BLE_Mode_Sleep(void);
 extern void BLE_Mode_Wakeup(void);
+extern void BLE_Mode_SleepWake(uint32_t wake_lf);
+extern void BLE_Set_Interval(uint16_t interval_ms);
+extern void BLE_Set_NextStart(uint32_t ms);
+extern void BLE_Set_Retain(uint32_t ms);
+extern void BLE_Get_WakeCount(uint32_t *cold, uint32_t *warm);
+extern void BLE_Cal_Env(uint16_t vdd_mv, int8_t temp_c);
+extern void BLE_Cal_Invalidate(void);
+extern void BLE_Get_CalCount(uint32_t *done, uint32_t *skipped);
+extern void BLE_Set_AdvData(const uint8_t *data, uint8_t len);
+extern void BLE_Set_AdvType(uint8_t type);
+extern void BLE_Set_Channel(uint8_t ch);
 extern void BLE_Set_TimeOut(uint32_t data_us);
 extern void BLE_Set_StartTime(uint32_t htime);
 extern uint8_t BLE_Get_RSSI(void);
-extern void BLE_Get_Pdu(uint8_t *ptr, uint8_t *len);
+extern uint8_t BLE_Read_Pdu_Head(BLE_PduTypeDef *pdu);
+extern void BLE_Read_Pdu_Data(BLE_PduTypeDef *pdu);
+extern uint8_t BLE_Read_Pdu(BLE_PduTypeDef *pdu);
+extern void BLE_Dump_Pdu(const BLE_PduTypeDef *pdu);
 
 #endif
 
@@ -0,0 +1,78 @@
+#ifndef _FASTIO_H_
+#define _FASTIO_H_
+
+#include <stdint.h>
+
+/* register level SPI/GPIO accessors for the radio hot path, inlined at the
+   call site. the FWLB calls cost a call, assert_param and a FlagStatus each,
+   which at 4 MHz is longer than a byte on the bus.
+   define FIO_FWLB to route them through the FWLB API again (asserts on) */
+//#define FIO_FWLB
+
+#ifndef FIO_FWLB
+
+__STATIC_INLINE void FIO_Spi_Put(uint8_t data)
+{
+    SPI->DATA = data;
+}
+
+__STATIC_INLINE uint32_t FIO_Spi_Done(void)
+{
+    return (SPI->STAT & SPI_FLAG_SPIF);
+}
+
+__STATIC_INLINE uint8_t FIO_Spi_Get(void)
+{
+    return (uint8_t)SPI->DATA;
+}
+
+__STATIC_INLINE void FIO_Set(GPIO_TypeDef *port, uint16_t pin)
+{
+    port->DOSE = pin;
+}
+
+__STATIC_INLINE void FIO_Clr(GPIO_TypeDef *port, uint16_t pin)
+{
+    port->DOCL = pin;
+}
+
+__STATIC_INLINE uint32_t FIO_Get(GPIO_TypeDef *port, uint16_t pin)
+{
+    return (port->DI & pin);
+}
+
+#else
+
+__STATIC_INLINE void FIO_Spi_Put(uint8_t data)
+{
+    SPI_SendData(SPI, data);
+}
+
+__STATIC_INLINE uint32_t FIO_Spi_Done(void)
+{
+    return (SPI_GetFlagStatus(SPI, SPI_FLAG_SPIF) != RESET);
+}
+
+__STATIC_INLINE uint8_t FIO_Spi_Get(void)
+{
+    return SPI_ReceiveData(SPI);
+}
+
+__STATIC_INLINE void FIO_Set(GPIO_TypeDef *port, uint16_t pin)
+{
+    GPIO_SetBits(port, pin);
+}
+
+__STATIC_INLINE void FIO_Clr(GPIO_TypeDef *port, uint16_t pin)
+{
+    GPIO_ResetBits(port, pin);
+}
+
+__STATIC_INLINE uint32_t FIO_Get(GPIO_TypeDef *port, uint16_t pin)
+{
+    return (GPIO_ReadInputDataBit(port, pin) != Bit_RESET);
+}
+
+#endif
+
+#endif
@@ -3,6 +3,14 @@
 
 #include "Spi.h"
 #include "Ble.h"
+#include "RxQueue.h"
+#include "RxFilter.h"
+#include "Timebase.h"
+#include "RxWin.h"
+#include "Tickless.h"
+#include "Trace.h"
+#include "Kv.h"
+#include "ScanLog.h"
 #include "BSP.h"
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef _KV_H_
+#define _KV_H_
+
+#include <stdint.h>
+
+/* key-value store in the last KV_SECTORS flash sectors, kept out of the image
+   (IROM size in the uvprojx). log structured: a set appends a record, sectors
+   are used in turn and the oldest is reclaimed into the newest, one stays
+   erased. RAM index of the latest record per key, rebuilt by KV_Init.
+   record: {key, len, crc16}, data padded to a word. len 0: deleted.
+   the live records together fit one sector (KV_LIVE_MAX), so a reclaim always
+   leaves room: 14 values of KV_VAL_MAX fit, not KV_KEY_MAX, a set past it
+   fails. Tools/HostSim/kv_sim: power cut and wear on a host flash image */
+#ifndef KV_BASE
+#define KV_BASE             0xF800UL    //64KB flash, 4 sectors from the top
+#endif
+#define KV_SECTORS          4
+#define KV_KEY_MAX          16
+#define KV_VAL_MAX          32          //bytes per value
+#define KV_LIVE_MAX         (FLASH_SECTOR_SIZE - 8) //sector header, one delete
+
+typedef enum
+{
+    KV_KEY_ADV_DATA = 0,    //u8[] adv_data, BLE_Set_AdvData
+    KV_KEY_ADV_TYPE,        //u8 ADV_IND ... , BLE_Set_AdvType
+    KV_KEY_TX_POWER,        //u8 BLE_TX_POWER_
+    KV_KEY_ADV_INTERVAL,    //u16 ms, BLE_Set_Interval
+    KV_KEY_TXCNT,           //u8 txcnt
+    KV_KEY_RXCNT,           //u8 rxcnt
+    KV_KEY_CAL_THR,         //BLE_CalThrTypeDef
+    KV_KEY_APP,             //first key free for the application
+}KV_KeyTypeDef;
+
+extern void KV_Init(void);
+extern uint8_t KV_Get(uint8_t key, void *buf, uint8_t max);
+extern uint8_t KV_Set(uint8_t key, const void *data, uint8_t len);
+extern uint8_t KV_Del(uint8_t key);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _RXFILTER_H_
+#define _RXFILTER_H_
+
+#include <stdint.h>
+
+/* duplicate filter: same advA + same payload within the window is reported once
+   table: RXF_DUP_SETS x RXF_DUP_WAYS entries, 6 bytes each, it needs about one
+   entry per advertiser heard within the window. Tools/HostSim/rxf_bench, 1000
+   advertisers at 100..1000ms, one 50ms rx window per 400ms event (12.5%),
+   reports over an exact filter: 8x4 +32%, 32x4 +17%, 64x4 +7%. with the
+   receiver on all the time no table that fits in RAM helps at 1000 */
+#ifndef RXF_DUP_SETS
+#define RXF_DUP_SETS        32  //power of 2
+#endif
+#ifndef RXF_DUP_WAYS
+#define RXF_DUP_WAYS        4
+#endif
+#define RXF_DUP_WINDOW      1000UL  //ms, default
+
+/* accept list, empty list accepts all. a PDU passes if its advA matches one
+   address prefix (checked before the payload is read) and its payload carries
+   one listed company ID or 16-bit service UUID */
+#define RXF_ADDR_MAX        4   //address prefixes
+#define RXF_ID_MAX          8   //company IDs + service UUIDs
+
+extern void RxF_Clear_List(void);
+extern uint8_t RxF_Add_Addr(const uint8_t *prefix, uint8_t len);
+extern uint8_t RxF_Add_Company(uint16_t id);
+extern uint8_t RxF_Add_Uuid16(uint16_t uuid);
+extern uint8_t RxF_Accept_Addr(const BLE_PduTypeDef *pdu);
+extern uint8_t RxF_Accept_Data(const BLE_PduTypeDef *pdu);
+
+extern void RxF_Set_DupWindow(uint32_t window_ms);
+extern uint8_t RxF_Is_Dup(const BLE_PduTypeDef *pdu);
+extern uint8_t RxF_Is_Seen(const BLE_PduTypeDef *pdu);
+extern uint16_t RxF_Get_DupCount(void);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _RXQUEUE_H_
+#define _RXQUEUE_H_
+
+#include <stdint.h>
+
+/* received PDU ring, single producer (GPIOB_IRQHandler), single consumer (main loop)
+   producer: RxQ_Alloc, fill, RxQ_Commit (or RxQ_Drop if full). consumer: RxQ_Front, use, RxQ_Pop */
+#define RXQ_SIZE        8   //PDU records, power of 2, max 128
+
+extern BLE_PduTypeDef *RxQ_Alloc(void);
+extern void RxQ_Commit(void);
+extern void RxQ_Drop(void);
+
+extern uint8_t RxQ_Count(void);
+extern BLE_PduTypeDef *RxQ_Front(void);
+extern void RxQ_Pop(void);
+
+extern uint16_t RxQ_Get_Drop(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _RXWIN_H_
+#define _RXWIN_H_
+
+#include <stdint.h>
+
+/* adaptive rx window. learns the earliest/latest PDU arrival after the BLE
+   wakes up and opens the receiver only around it, BLE_RX_TIMEOUT at most.
+   arrivals are against our own wakeup, so they drift with the advertiser's
+   clock and advDelay: the drift per wakeup is learned and the window moves
+   with it, the scatter around it (jitter) widens it. misses widen the window,
+   RXW_MISS_MAX misses in a row go back to full. Tools/HostSim/rxwin_sim: a
+   peer on BLE_ADV_INTERVAL at 20ppm, 1.3ms rx per wakeup against 30ms at the
+   same capture. advDelay advertisers: about the rx time of the fixed window */
+#define RXW_MIN_US          2000    //shortest window
+#define RXW_MARGIN_US       1000    //added before/after the learned arrivals
+#define RXW_MISS_MAX        4
+#define RXW_DECAY           3       //arrival bounds relax by 1/8 per hit
+#define RXW_DRIFT_DECAY     2       //drift estimate follows by 1/4 per hit
+
+typedef struct
+{
+    uint32_t windows;               //rx windows opened
+    uint32_t hits;                  //windows that got a PDU
+    uint32_t rx_us;                 //receiver on time, estimated
+}RxW_StatTypeDef;
+
+extern void RxW_Reset(void);
+extern void RxW_Next(uint32_t *start_us, uint32_t *timeout_us);
+extern void RxW_Hit(uint32_t offset_us);
+extern void RxW_End(void);
+
+extern void RxW_Set_Expect(uint8_t cnt);
+extern uint8_t RxW_Get_Expect(void);
+extern const RxW_StatTypeDef *RxW_Get_Stat(void);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _SCANLOG_H_
+#define _SCANLOG_H_
+
+#include <stdint.h>
+
+/* scan record ring in the SL_SECTORS flash sectors below the KV store, kept out
+   of the image (IROM size in the uvprojx). SL_Put collects records in RAM,
+   SL_Poll writes SL_BATCH of them at once, the oldest sector is erased when
+   the ring is full. sector: {magic, seq}, then batches {tag, count, crc16}
+   + count records. header first: a batch cut short fails its CRC and is
+   skipped by the iterator, a broken header ends the sector.
+   records carry the rx stamp, TB_Get_Us, 71 min wrap. mark records tie it to
+   TK_Get_Ms: SL_LEN_BOOT written by SL_Init on each power-up, SL_LEN_CLOCK
+   ahead of a record SL_CLOCK_MS or more after the last mark. record ms since
+   boot: mark ms + (int32_t)(us - mark us)/1000 */
+#ifndef SL_BASE
+#define SL_BASE             0xE800UL    //8 sectors up to KV_BASE
+#endif
+#define SL_SECTORS          8
+#define SL_BATCH            8           //records per flash write, RAM buffer
+#define SL_CLOCK_MS         (30*60000UL) //mark interval, less than the us wrap
+
+#define SL_TYPE_MARK        0xFF        //type of a mark record
+#define SL_LEN_BOOT         0xFF        //len of a mark record, adv data <= 31
+#define SL_LEN_CLOCK        0xFE
+
+#define SL_CMD_DUMP         'D'         //Uart_Get command, SL_Dump
+
+//16 bytes, the flash and SL_Dump format. mark: us TB_Get_Us(), addr[0..3]
+//TK_Get_Ms() little endian, the rest 0
+typedef struct
+{
+    uint32_t us;                    //pdu->time, TB_Get_Us() at rx
+    uint8_t addr[LEN_BLE_ADDR];     //advA
+    uint8_t type;                   //pdu hdr[0]
+    uint8_t len;                    //adv data bytes
+    uint8_t rssi;
+    uint8_t ch;
+    uint16_t hash;                  //CRC-16 of the adv data
+}SL_RecordTypeDef;
+
+typedef struct
+{
+    uint8_t n;                      //sectors done
+    uint32_t addr;                  //next record
+    uint32_t end;                   //end of its batch
+}SL_IterTypeDef;
+
+extern void SL_Init(void);
+extern uint8_t SL_Put(const BLE_PduTypeDef *pdu);
+extern void SL_Poll(void);
+extern void SL_Flush(void);
+extern uint16_t SL_Get_Drop(void);
+
+extern void SL_Iter_Init(SL_IterTypeDef *it);
+extern const SL_RecordTypeDef *SL_Iter_Next(SL_IterTypeDef *it);
+extern void SL_Dump(void);
+
+#endif
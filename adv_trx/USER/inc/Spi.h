@@ -4,16 +4,22 @@
 #include <stdint.h>
 
 
-#define BLE_IRQ_GET()    (GPIO_ReadInputDataBit(GPIOB,GPIO_Pin_4))
+#define BLE_IRQ_GET()    FIO_Get(GPIOB,GPIO_Pin_4)
+
+/* BLE CSN, a GPIO. MS1656 bonds it to PC4, which carries no SPI NSS output */
+#define BLE_CSN_PORT        GPIOC
+#define BLE_CSN_PIN         GPIO_Pin_4
 
 #ifdef  BLE_DEBUG
-  #define BLE_CSN_CLR()    GPIO_ResetBits(GPIOA,GPIO_Pin_3);GPIO_ResetBits(GPIOC,GPIO_Pin_4)
-  #define BLE_CSN_SET()    GPIO_SetBits(GPIOA,GPIO_Pin_3);GPIO_SetBits(GPIOC,GPIO_Pin_4)
+  #define BLE_CSN_CLR()    FIO_Clr(GPIOA,GPIO_Pin_3);FIO_Clr(BLE_CSN_PORT,BLE_CSN_PIN)
+  #define BLE_CSN_SET()    FIO_Set(GPIOA,GPIO_Pin_3);FIO_Set(BLE_CSN_PORT,BLE_CSN_PIN)
 #else
-  #define BLE_CSN_CLR()    GPIO_ResetBits(GPIOC,GPIO_Pin_4)
-  #define BLE_CSN_SET()    GPIO_SetBits(GPIOC,GPIO_Pin_4)
+  #define BLE_CSN_CLR()    FIO_Clr(BLE_CSN_PORT,BLE_CSN_PIN)
+  #define BLE_CSN_SET()    FIO_Set(BLE_CSN_PORT,BLE_CSN_PIN)
 #endif
 
+extern void SPI_Csn_Init(void);
+
 extern uint8_t SPI_Write_Byte(uint8_t data1) ;
 extern uint8_t SPI_Read_Byte(void) ;
 
@@ -23,4 +29,37 @@ extern uint8_t SPI_Read_Reg(uint8_t reg) ;
 extern void SPI_Write_Buffer(uint8_t reg, uint8_t *dataBuf, uint8_t len);
 extern void SPI_Read_Buffer(uint8_t reg, uint8_t *dataBuf, uint8_t len);
 
+/* register sequence, stored in flash: {len, cmd, data[len]} ... SEQ_END
+   cmd is sent as-is, reg 0x00--0x1F must carry the 0x20 write bit (SEQ_BUF) */
+#define SEQ_REG(reg, data)  1, (reg), (data)
+#define SEQ_BUF(reg, len)   (len), ((reg)|0x20)
+#define SEQ_BANK(bank)      SEQ_REG(BANK_SEL, (bank))   //dropped if already selected
+#define SEQ_END             0
+
+extern void SPI_Write_Seq(const uint8_t *seq);
+
+extern void SPI_Select_Bank(uint8_t bank);
+extern void SPI_Reset_Bank(void);
+
+/* interrupt driven transfers on SPI0COMB_IRQn, queued and run in order.
+   the blocking functions above wait until the queue is empty. */
+#define SPI_ASYNC_DEPTH     4   //queued transfers
+
+#define SPI_DIR_WRITE       0   //reg|0x20, then buf[0..len-1]
+#define SPI_DIR_READ        1   //reg, then len bytes into buf
+
+typedef struct
+{
+    uint8_t reg;
+    uint8_t dir;
+    uint8_t len;
+    uint8_t *buf;               //must stay valid until done
+    uint8_t bank;               //BANK_5x selected first if needed, 0: as is
+    void (*done)(void);         //called from the SPI interrupt, may be 0
+}SPI_XferTypeDef;
+
+extern uint8_t SPI_Async_Submit(const SPI_XferTypeDef *xfer);
+extern uint8_t SPI_Async_Busy(void);
+extern void SPI_Async_Wait(void);
+
 #endif
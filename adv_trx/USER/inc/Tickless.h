@@ -0,0 +1,27 @@
+#ifndef _TICKLESS_H_
+#define _TICKLESS_H_
+
+#include <stdint.h>
+
+/* tickless timer: LPTIMER on LIRC, one-shot to the nearest deadline, runs in
+   deep sleep. with nothing pending it still wakes every 0xFFFF ticks (1.7s)
+   to keep TK_Get_Ms */
+#define TK_CLK_HZ           38400UL     //LIRC
+#define TK_PERIOD_MAX       0xFFFFUL    //16bit counter
+
+typedef enum
+{
+    TK_ID_DELAY = 0,        //Delay_ms
+    TK_ID_GUARD,            //BLE guard, see MG127.c
+    TK_ID_MAX,
+}TK_IdTypeDef;
+
+extern void TK_Init(void);
+extern void TK_Start(uint8_t id, uint32_t ms, void (*expire)(void));
+extern void TK_Stop(uint8_t id);
+extern uint8_t TK_Running(uint8_t id);
+extern void TK_Sleep_Until(uint8_t id);
+extern uint32_t TK_Get_Ms(void);
+extern uint32_t TK_Get_Ticks(void);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _TIMEBASE_H_
+#define _TIMEBASE_H_
+
+#include <stdint.h>
+
+/* us timebase. BLE CLK_CNT LF counter (LFCLK_1MS) while the BLE is powered up,
+   LPTIMER ticks (TK_Get_Ticks, no SPI) while it is powered down and to count
+   LF counter wraps. TB_Get_Us wraps after 71 min, compare with (int32_t)(a - b) */
+#define TB_CNT_MASK         0xFFFFFFUL  //24bit LF and HF counters
+#define TB_LF_WRAP_MS       (0x1000000UL/LFCLK_1MS)
+
+#define TB_HF_TO_US(hf)     ((hf)/(HFCLK_1MS/1000))
+
+extern void TB_Radio_On(void);
+extern void TB_Radio_Off(void);
+extern uint32_t TB_Get_Us(void);
+extern uint32_t TB_Get_Hf(void);
+
+#endif
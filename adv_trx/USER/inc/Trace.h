@@ -0,0 +1,46 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+/* binary event trace on the UART, formatted on the host by
+   Tools/TraceDecode/trace_decode.c. frame, COBS encoded and 0x00 terminated:
+   {id, ms[2], arg[0..TR_ARG_MAX-1]}, ms = TK_Get_Ms() low 16 bit, multi-byte
+   args little endian. TRACE_ON 0: ASCII hex debug output instead.
+   new ids go at the end, the decoder keeps the same table */
+#ifndef TRACE_ON
+#define TRACE_ON            1
+#endif
+#define TR_ARG_MAX          48
+
+typedef enum
+{
+    TR_ID_BOOT = 0,         //no arg
+    TR_ID_CHIP,             //u8 chip version
+    TR_ID_ADDR,             //u8[6] BLE address, LSB first
+    TR_ID_EVT_START,        //u8 state the event starts from
+    TR_ID_RX_WIN,           //u32 start us, u32 timeout us
+    TR_ID_RX_HIT,           //u32 offset us, u8 rssi, u8 pdu type
+    TR_ID_EVT_END,          //u8 wanted PDUs, u8 next, 0: idle 1: sleep
+    TR_ID_GUARD,            //u8 state, guard time ran out
+    TR_ID_PDU,              //u8 rssi, u8 ch, u8 hdr[2], u8 addr[6], u8 data[]
+    TR_ID_UART_DROP,        //u32 bytes dropped so far
+    TR_ID_SCAN,             //SL_RecordTypeDef, SL_Dump
+    TR_ID_CAL,              //u32 calibrations done, u32 skipped
+    TR_ID_WAKE,             //u32 us BLE_Start to BLE wakeup, u32 1: warm start
+    TR_ID_IDLE,             //u32 expected gap ms, u32 1: light sleep 0: power down
+    TR_ID_MAX,
+}TR_IdTypeDef;
+
+#if TRACE_ON
+  #define TRACE(id, arg, len)       TR_Put((id), (arg), (len))
+  #define TRACE_U32(id, a, b)       TR_Put_U32((id), (a), (b))
+#else
+  #define TRACE(id, arg, len)
+  #define TRACE_U32(id, a, b)
+#endif
+
+extern void TR_Put(uint8_t id, const uint8_t *arg, uint8_t len);
+extern void TR_Put_U32(uint8_t id, uint32_t a, uint32_t b);
+
+#endif
@@ -15,11 +15,20 @@ SPIDEBUG:
 PA3=NSS,PB5=SCK,PD6=MOSI
 ***/
 
-#define trim_24M    (*((volatile uint16_t*)(0x180000C0))&0x0fff);
-#define trim_22M    (*((volatile uint16_t*)(0x180000C2))&0x0fff);
-#define trim_16M    (*((volatile uint16_t*)(0x180000C4))&0x0fff);
-#define trim_8M     (*((volatile uint16_t*)(0x180000C6))&0x0fff);
-#define trim_4M     (*((volatile uint16_t*)(0x180000C8))&0x0fff);
+#define UARTx UART0
+#define TIMx  TIM10
+
+#ifdef UART_TX_DEEPSLEEP
+  #define UART_TX_SEND(data)    LPUART_SendData(LPUART, (data))
+#else
+  #define UART_TX_SEND(data)    UART_SendData(UARTx, (data))
+#endif
+
+#define trim_24M    (*((volatile uint16_t*)(0x180000C0))&0x0fff)
+#define trim_22M    (*((volatile uint16_t*)(0x180000C2))&0x0fff)
+#define trim_16M    (*((volatile uint16_t*)(0x180000C4))&0x0fff)
+#define trim_8M     (*((volatile uint16_t*)(0x180000C6))&0x0fff)
+#define trim_4M     (*((volatile uint16_t*)(0x180000C8))&0x0fff)
 //#define HIRC24M_FLASHADDR					0x180000C0
 //#define HIRC22M_FLASHADDR					0x180000C2
 //#define HIRC16M_FLASHADDR					0x180000C4
@@ -37,8 +46,119 @@ void SysClock_Init(void)
     
     RCC->REGLOCK = RCC_RESGLOCKKEY;
     
-    SysTick_Config(4000); //4M
-    //SysTick_Config(24000); //24M
+    //no SysTick: time and delays run on LPTIMER, see TK_Init
+}
+
+static volatile uint8_t sysclk_burst = 0;   //SysClock_Burst_Enter nesting
+static uint32_t sysclk_hz = SYSCLK_IDLE_HZ;
+
+//Uart_Put ring, drained by UART0_IRQHandler
+static uint8_t uart_tx_buf[UART_TX_SIZE];
+static volatile uint16_t uart_tx_head = 0;  //next byte to the wire
+static volatile uint16_t uart_tx_tail = 0;  //next free slot
+static volatile uint8_t uart_tx_busy = 0;   //byte in the shift register
+static uint32_t uart_tx_drop = 0;           //bytes not queued, ring full
+
+//Uart_Get ring, filled by UART0_IRQHandler/LPUART_IRQHandler
+static uint8_t uart_rx_buf[UART_RX_SIZE];
+static volatile uint8_t uart_rx_head = 0;
+static volatile uint8_t uart_rx_tail = 0;
+
+/*******************************************************************************
+* Function   :      UART_Set_Baud
+* Parameter  :      uint32_t hz, PCLK
+* Returns    :      void
+* Description:      UART_BAUD from the UART's own BRG
+* Note:      :      DBAUD on: BRG = hz*2/(32*baud), rounded, -1
+*******************************************************************************/
+static void UART_Set_Baud(uint32_t hz)
+{
+    UARTx->BRG = UART_SELF_BRG | ((hz*2 + UART_BAUD*16) / (UART_BAUD*32) - 1);
+}
+
+/*******************************************************************************
+* Function   :      SysClock_Set
+* Parameter  :      uint8_t burst, 1: SYSCLK_BURST_HZ, 0: SYSCLK_IDLE_HZ
+* Returns    :      void
+* Description:      switch HIRC, re-derive the UART baud
+* Note:      :      SPI idle and no UART byte on the wire across the switch.
+*                   SPI keeps /4: 1MHz idle as before, 6MHz in a burst.
+*                   LPTIMER runs on LIRC and UART on its own BRG (not TIM10),
+*                   neither needs more
+*******************************************************************************/
+static void SysClock_Set(uint8_t burst)
+{
+    uint32_t trim;
+    uint32_t en = NVIC->ISER[0] & (1UL << GPIOB_IRQn);
+    uint32_t uen = NVIC->ISER[0] & (1UL << UART0_IRQn);
+
+    NVIC_DisableIRQ(GPIOB_IRQn);    //the other SPI user
+    SPI_Async_Wait();
+    NVIC_DisableIRQ(UART0_IRQn);    //no next byte until the new baud
+#ifndef UART_TX_DEEPSLEEP
+    if(uart_tx_busy){
+        while(UART_GetITStatus(UARTx, UART_ISR_TI) != SET); //TI left for the IRQ
+    }
+#endif
+
+    if(burst){
+        trim = trim_24M;
+        sysclk_hz = SYSCLK_BURST_HZ;
+    }else{
+        trim = trim_4M;
+        sysclk_hz = SYSCLK_IDLE_HZ;
+    }
+
+    RCC->REGLOCK = RCC_REGLOCKKEY;
+    RCC->HIRCCR = RCC_HIRCCLK_KEY | trim;
+    while(!(RCC->HIRCCR & RCC_FLAG_HIRCRDY)); //HIRC_stable
+    RCC->REGLOCK = RCC_RESGLOCKKEY;
+
+    UART_Set_Baud(sysclk_hz);
+
+    if(uen) NVIC_EnableIRQ(UART0_IRQn);
+    if(en) NVIC_EnableIRQ(GPIOB_IRQn);
+}
+
+/*******************************************************************************
+* Function   :      SysClock_Burst_Enter
+* Parameter  :      void
+* Returns    :      void
+* Description:      SYSCLK_BURST_HZ until the matching SysClock_Burst_Exit
+* Note:      :      nests, thread and GPIOB_IRQHandler
+*******************************************************************************/
+void SysClock_Burst_Enter(void)
+{
+    uint8_t first;
+
+    __disable_irq();
+    first = (sysclk_burst++ == 0);
+    __enable_irq();
+
+    if(first) SysClock_Set(1);
+}
+
+/*******************************************************************************
+* Function   :      SysClock_Burst_Exit
+* Parameter  :      void
+* Returns    :      void
+* Description:      back to SYSCLK_IDLE_HZ after the last exit
+* Note:      :
+*******************************************************************************/
+void SysClock_Burst_Exit(void)
+{
+    uint8_t last;
+
+    __disable_irq();
+    last = (--sysclk_burst == 0);
+    __enable_irq();
+
+    if(last) SysClock_Set(0);
+}
+
+uint32_t SysClock_Get_Hz(void)
+{
+    return sysclk_hz;
 }
 /*******************************************************************************
 * Function   :      SPIM_Init
@@ -56,7 +176,9 @@ void SPIM_Init(void)
     RCC->AHBCLKEN = RCC_AHBPeriph_GPIOAEN   | 
                     RCC_AHBPeriph_GPIOBEN   | 
                     RCC_AHBPeriph_GPIOCEN   | 
-                    RCC_AHBPeriph_GPIODEN;
+                    RCC_AHBPeriph_GPIODEN   |
+                    RCC_AHBPeriph_CRCEN     |     //CRC_STREAM_HW
+                    RCC_AHBPeriph_FLASHCE;
     RCC->APBCLKEN = RCC_APBPeriph_SPICKEN   |
                     RCC_APBPeriph_UART0CKEN |
                     RCC_APBPeriph_IWDTCKEN;
@@ -90,13 +212,7 @@ void SPIM_Init(void)
     GPIO_PinAFConfig(GPIOD, GPIO_PinSource6, GPIO_AF_SPI_MOSI_PD6); //Spimosi
 #endif
     //SPI_NSS :PC4 (software)
-    GPIO_InitStruct.GPIO_Mode = GPIO_Mode_OUT;
-    GPIO_InitStruct.GPIO_OType = GPIO_OType_PP;
-    GPIO_InitStruct.GPIO_Pin = GPIO_Pin_4;
-    GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_NOPULL;
-    GPIO_InitStruct.GPIO_Speed = GPIO_Speed_25MHz;
-    GPIO_Init(GPIOC, &GPIO_InitStruct);
-    GPIO_SetBits(GPIOC, GPIO_Pin_4);
+    SPI_Csn_Init();
 
     //SPI_CLK :PC5
     GPIO_InitStruct.GPIO_Mode = GPIO_Mode_OUT;
@@ -129,13 +245,14 @@ void SPIM_Init(void)
     SPI_InitStruct.SPI_Mode = SPI_Mode_Master;
     SPI_InitStruct.SPI_CPOL = SPI_CPOL_Low;
     SPI_InitStruct.SPI_CPHA = SPI_CPHA_1Edge;
-    SPI_InitStruct.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_4;
+    SPI_InitStruct.SPI_BaudRatePrescaler = SPI_BaudRatePrescaler_4; //1MHz idle, 6MHz burst, see SysClock_Set
     SPI_Init(SPI,&SPI_InitStruct);
     SPI_Cmd(SPI,ENABLE);   
+
+    //SPI_Async_*: above BLE IRQ/RTC, so their handlers can wait on it
+    NVIC_SetPriority(SPI0COMB_IRQn,1);
 }
 
-#define UARTx UART0
-#define TIMx  TIM10
 void UART_Config(void)
 {
     GPIO_InitTypeDef GPIO_InitStruct;
@@ -163,7 +280,7 @@ void UART_Config(void)
 
     // ôڵĹ
     // ò
-    UART_InitStructure.UART_BaudRate = 115200; //24M - 115200bps, 4M - 19200bps
+    UART_InitStructure.UART_BaudRate = 115200; //24M - 115200bps, 4M - 19200bps. UART_Set_Baud below
     //  ֳ
     UART_InitStructure.UART_BaudRateDbaud_Enable = ENABLE;
     // ֹͣλ
@@ -173,6 +290,7 @@ void UART_Config(void)
 
     // ɴڵĳʼ
     UART_Init(UART0, TIMx, &UART_InitStructure);
+    UART_Set_Baud(sysclk_hz); //UART_Init assumes Fpclk 24MHz
     
     // жȼ
     //NVIC_Configuration();
@@ -183,7 +301,65 @@ void UART_Config(void)
 
     // ʹܴ
     UART_Cmd(UART0, UART_RXEN_EABLE, ENABLE);
+
+    //TX ring, below the radio interrupts
+    NVIC_SetPriority(UART0_IRQn,3);
+    NVIC_EnableIRQ(UART0_IRQn);
+}
+
+#ifdef LOG_LPUART
+/*******************************************************************************
+* Function   :      LPUART_Config
+* Parameter  :      void
+* Returns    :      void
+* Description:      LPUART on LIRC, low power mode: RX on PA3, TX if UART_TX_DEEPSLEEP
+* Note:      :      runs and interrupts in deep sleep, RX wakes the MCU
+*******************************************************************************/
+static void LPUART_Config(void)
+{
+    GPIO_InitTypeDef GPIO_InitStruct;
+    LPUART_InitTypeDef LPUART_InitStruct;
+
+    RCC->APBCLKEN |= RCC_APBPeriph_LPUARTCKEN;
+    SYSCTRL_LPUART_CLKConfig(SYSCTRL, LPUARTCLK_LIRC);
+    SYSCTRL_LPUART_CLKCmd(SYSCTRL, ENABLE);
+
+    GPIO_InitStruct.GPIO_Mode = GPIO_Mode_IN;
+    GPIO_InitStruct.GPIO_OType = GPIO_OType_PP;
+    GPIO_InitStruct.GPIO_Pin = GPIO_Pin_3;
+    GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_UP;
+    GPIO_InitStruct.GPIO_Speed = GPIO_Speed_2MHz;
+    GPIO_Init(GPIOA, &GPIO_InitStruct);
+    GPIO_PinAFConfig(GPIOA, GPIO_PinSource3, GPIO_AF_LPUART_RX_PA3);
+
+#ifdef UART_TX_DEEPSLEEP
+    GPIO_InitStruct.GPIO_Mode = GPIO_Mode_OUT;
+    GPIO_InitStruct.GPIO_Pin = LPUART_TX_PIN;
+    GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_NOPULL;
+    GPIO_Init(LPUART_TX_PORT, &GPIO_InitStruct);
+    GPIO_PinAFConfig(LPUART_TX_PORT, LPUART_TX_PIN_SOURCE, LPUART_TX_AF);
+#endif
+
+    LPUART_InitStruct.LPUART_BaudRate = LPUART_BAUD;
+    LPUART_InitStruct.LPUART_BaudRateDbaud_Enable = DISABLE;
+    LPUART_InitStruct.LPUART_BaudRateTimer_Selected = DISABLE; //LPTIMER is TK_
+    LPUART_InitStruct.LPUART_Mode = LPUART_MODE1;
+    LPUART_InitStruct.LPUART_SCLKSEL = LPUART_SCLK_LIRC;
+    LPUART_InitStruct.LPUART_SCLKPRS = LPUART_SCLK_DIV4;        //LPUART_BAUD
+    LPUART_Init(LPUART, LPTIMER, &LPUART_InitStruct, ENABLE);
+    LPUART_LowPowerCmd(LPUART, ENABLE);
+
+    LPUART_ClearITFlag(LPUART, LPUART_ICR_ALL);
+    LPUART_ITConfig(LPUART, LPUART_RIEN_EABLE, ENABLE);
+#ifdef UART_TX_DEEPSLEEP
+    LPUART_ITConfig(LPUART, LPUART_TIEN_EABLE, ENABLE);
+#endif
+    LPUART_Cmd(LPUART, LPUART_RXEN_EABLE, ENABLE);
+
+    NVIC_SetPriority(LPUART_IRQn,3);
+    NVIC_EnableIRQ(LPUART_IRQn);
 }
+#endif
 
 /*******************************************************************************
 * Function   :      LED_KEY_Config
@@ -238,12 +414,14 @@ void RTCInit(void)
 
     RTC_RtcClkCmd(RTC,ENABLE);
 
+#ifndef WMODE_INT   //WMODE_INT: adv events timed by BLE, see BLE_Set_Interval()
     RTC_SetAlarm2(RTC,2);  //1-800ms, 2-400ms
     RTC_AlarmCmd(RTC,RTC_IT_ALM2, ENABLE);
     RTC_AlarmCmd(RTC,RTC_IT_ALMEN, ENABLE);
 
     NVIC_EnableIRQ(RTC_MATCH0_IRQn);
     NVIC_SetPriority(RTC_MATCH0_IRQn,2);
+#endif
 
     RTC_CountCmd(RTC,ENABLE);
     
@@ -289,7 +467,7 @@ void BSP_Init(void)
     GPIO_InitStruct.GPIO_Mode = GPIO_Mode_IN;
     GPIO_Init(GPIOB, &GPIO_InitStruct);
 
-#ifdef WMODE_INT    /*EXITж*/
+    /*EXITж*/
     GPIO_IRQ_InitStruct.GPI0_IRQ_Pin_Type = DISABLE;        //0-ش1-ƽ
     GPIO_IRQ_InitStruct.GPI0_IRQ_Pin_Polarity = DISABLE;     //0-͵ƽ½ش1-ߵƽش
     GPIO_IRQ_InitStruct.GPI0_IRQ_Pin_Edge =  DISABLE;       //0-Ĵ1-غ½ضж
@@ -302,113 +480,222 @@ void BSP_Init(void)
     NVIC_InitStruct.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStruct.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStruct);
-#endif
 
     UART_Config();
+#ifdef LOG_LPUART
+    LPUART_Config();
+#endif
     RTCInit();
+    TK_Init();
+    TRACE(TR_ID_BOOT, 0, 0);
+    KV_Init();
+    SL_Init();
     
     LED_KEY_Config();
     
 //    IWDG_Config();
 }
 
+/*******************************************************************************
+* Function   :      Uart_Put
+* Parameter  :      const char *data, uint16_t len
+* Returns    :      uint8_t, 1: queued, 0: ring full, dropped
+* Description:      queue len bytes for the log port, returns at once
+* Note:      :      all or nothing, dropped bytes counted in Uart_Get_Drop.
+*                   thread and interrupts: copies with interrupts off, keep
+*                   len short (a trace frame, a line)
+*******************************************************************************/
+uint8_t Uart_Put(const char *data, uint16_t len)
+{
+    uint16_t tail;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    tail = uart_tx_tail;
+    if(len > (UART_TX_SIZE - 1) - ((tail - uart_tx_head) & (UART_TX_SIZE - 1))){
+        uart_tx_drop += len;
+        __set_PRIMASK(primask);
+        return 0;
+    }
+
+    while(len--){
+        uart_tx_buf[tail] = *data++;
+        tail = (tail + 1) & (UART_TX_SIZE - 1);
+    }
+    uart_tx_tail = tail;
+
+    if(!uart_tx_busy){  //idle, start now. next bytes from Uart_Tx_Next
+        uart_tx_busy = 1;
+        UART_TX_SEND(uart_tx_buf[uart_tx_head]);
+        uart_tx_head = (uart_tx_head + 1) & (UART_TX_SIZE - 1);
+    }
+    __set_PRIMASK(primask);
+
+    return 1;
+}
+
 /*******************************************************************************
 * Function   :      Uart_Send_Byte
 * Parameter  :      uint8_t data
 * Returns    :      void
-* Description:
-* Note:      :
+* Description:      queue data as 2 hex chars
+* Note:      :      non-blocking, see Uart_Put
 *******************************************************************************/
 void Uart_Send_Byte(char data)
 {
     uint8_t temp;
-    uint8_t temp0[2];
+    char temp0[2];
 
     //1byte hex to asdcii 2byte.
-    temp = data & 0x0F;
+    temp = (data >> 4) & 0x0F;
     temp0[0] = Hex2Ascii(temp);
     
-    temp = data >> 4;
+    temp = data & 0x0F;
     temp0[1] = Hex2Ascii(temp);
 
-    //usart send data
-    UART_SendData(UARTx,temp0[1]);
-
-    /* Wait until end of transmit */
-    while(UART_GetITStatus(UARTx, UART_ISR_TI) !=  SET);
-    UART_ClearITBit(UARTx, UART_ISR_TI);
-
-    UART_SendData(UARTx,temp0[0]);
-    /* Wait until end of transmit */
-    while(UART_GetITStatus(UARTx, UART_ISR_TI) !=  SET);
-    UART_ClearITBit(UARTx, UART_ISR_TI);
+    Uart_Put(temp0, 2);
 }
 
 /*******************************************************************************
 * Function   :      Uart_Send_String
 * Parameter  :      uint8_t *data
 * Returns    :      void
-* Description:
-* Note:      :
+* Description:      queue a string
+* Note:      :      non-blocking, see Uart_Put
 *******************************************************************************/
 void Uart_Send_String(char *data)
 {
-    //check string end char
-    while(*data != '\0')
-    {
-        UART_SendData(UARTx,*data);
-
-        /* Wait until end of transmit */
-        while(UART_GetITStatus(UARTx, UART_ISR_TI) !=  SET);
-        UART_ClearITBit(UARTx, UART_ISR_TI);
-        
-        data++;	
-    }
+    Uart_Put(data, strlen(data));
 }
 
 /*******************************************************************************
-* Function   :      KEY_GET
+* Function   :      Uart_Get_Drop
 * Parameter  :      void
-* Returns    :      void
-* Description:
+* Returns    :      uint32_t
+* Description:      bytes dropped since BSP_Init, ring full
 * Note:      :
 *******************************************************************************/
-char KEY_GET(void)
+uint32_t Uart_Get_Drop(void)
 {
-    return (!GPIO_ReadInputDataBit(KEY1_GPIO_PORT, KEY1_GPIO_PORT_PIN));
+    return uart_tx_drop;
 }
 
-void LED_RED_ON(void)
+/*******************************************************************************
+* Function   :      Uart_Flush
+* Parameter  :      void
+* Returns    :      void
+* Description:      sleep until the ring and the last byte are on the wire
+* Note:      :      call before deep sleep, HIRC and UART0 stop there.
+*                   not needed with UART_TX_DEEPSLEEP
+*******************************************************************************/
+void Uart_Flush(void)
 {
-    GPIO_SetBits(LED2_GPIO_PORT, LED2_GPIO_PORT_PIN);
+    while(uart_tx_busy)
+    {
+        __disable_irq();
+        if(uart_tx_busy){
+            SCB->SCR &= (~0x04);
+            __WFI();
+        }
+        __enable_irq();
+    }
 }
-void LED_RED_OFF(void)
+
+/*******************************************************************************
+* Function   :      Uart_Get
+* Parameter  :      uint8_t *data
+* Returns    :      uint8_t, 1: a byte in *data, 0: none
+* Description:      next received command byte, UART0 or LPUART
+* Note:      :      returns at once
+*******************************************************************************/
+uint8_t Uart_Get(uint8_t *data)
 {
-    GPIO_ResetBits(LED2_GPIO_PORT, LED2_GPIO_PORT_PIN);
+    if(uart_rx_head == uart_rx_tail) return 0;
+
+    *data = uart_rx_buf[uart_rx_head];
+    uart_rx_head = (uart_rx_head + 1) & (UART_RX_SIZE - 1);
+    return 1;
 }
-void LED_GREEN_ON(void)
+
+/*******************************************************************************
+* Function   :      Uart_Rx_Put
+* Parameter  :      uint8_t data
+* Returns    :      void
+* Description:      store a received byte for Uart_Get
+* Note:      :      ring full: the byte is lost
+*******************************************************************************/
+static void Uart_Rx_Put(uint8_t data)
 {
-    GPIO_SetBits(LED1_GPIO_PORT, LED1_GPIO_PORT_PIN);
+    uint8_t next = (uart_rx_tail + 1) & (UART_RX_SIZE - 1);
+
+    if(next != uart_rx_head){
+        uart_rx_buf[uart_rx_tail] = data;
+        uart_rx_tail = next;
+    }
 }
-void LED_GREEN_OFF(void)
+
+/*******************************************************************************
+* Function   :      Uart_Tx_Next
+* Parameter  :      void
+* Returns    :      void
+* Description:      byte sent: send the next from the ring or go idle
+* Note:      :      from the TX port interrupt
+*******************************************************************************/
+static void Uart_Tx_Next(void)
 {
-    GPIO_ResetBits(LED1_GPIO_PORT, LED1_GPIO_PORT_PIN);
+    if(uart_tx_head != uart_tx_tail){
+        UART_TX_SEND(uart_tx_buf[uart_tx_head]);
+        uart_tx_head = (uart_tx_head + 1) & (UART_TX_SIZE - 1);
+    }else{
+        uart_tx_busy = 0;
+    }
 }
 
 /*******************************************************************************
-* Function   :      SysTick_Handler
+* Function   :      UART0_IRQHandler
 * Parameter  :      void
 * Returns    :      void
-* Description:
+* Description:      UART0 RX byte to Uart_Get, TX done to Uart_Tx_Next
 * Note:      :
 *******************************************************************************/
-unsigned short tick = 0;
+void UART0_IRQHandler(void)
+{
+    if(UART_GetITStatus(UARTx, UART_ISR_RI) == SET){
+        UART_ClearITBit(UARTx, UART_ISR_RI);
+        Uart_Rx_Put(UART_ReceiveData(UARTx));
+    }
 
-void SysTick_Handler(void)
+    if(UART_GetITStatus(UARTx, UART_ISR_TI) == SET){
+        UART_ClearITBit(UARTx, UART_ISR_TI);
+#ifndef UART_TX_DEEPSLEEP
+        Uart_Tx_Next();
+#endif
+    }
+}
+
+#ifdef LOG_LPUART
+/*******************************************************************************
+* Function   :      LPUART_IRQHandler
+* Parameter  :      void
+* Returns    :      void
+* Description:      LPUART RX byte to Uart_Get, TX done to Uart_Tx_Next
+* Note:      :      wakes the MCU from deep sleep
+*******************************************************************************/
+void LPUART_IRQHandler(void)
 {
-    NVIC_ClearPendingIRQ(SysTick_IRQn);
-    if(tick>0) tick--;
+    if(LPUART_GetFlagStatus(LPUART, LPUART_ISR_RI) == SET){
+        LPUART_ClearITFlag(LPUART, LPUART_ICR_RI);
+        Uart_Rx_Put(LPUART_ReceiveData(LPUART));
+    }
+
+    if(LPUART_GetFlagStatus(LPUART, LPUART_ISR_TI) == SET){
+        LPUART_ClearITFlag(LPUART, LPUART_ICR_TI);
+#ifdef UART_TX_DEEPSLEEP
+        Uart_Tx_Next();
+#endif
+    }
 }
+#endif
 
 /*******************************************************************************
 * Function   :      RTC_MATCH0_IRQHandler
@@ -420,13 +707,29 @@ void SysTick_Handler(void)
 void RTC_MATCH0_IRQHandler(void)
 {
     RTC_ClearFlag(RTC,RTC_IT_ALM2);
-#ifdef WMODE_INT
-    BLE_Start();
-#endif
 }
 
+/*******************************************************************************
+* Function   :      Delay_ms
+* Parameter  :      uint16_t delayCnt
+* Returns    :      void
+* Description:      sleep delayCnt ms
+* Note:      :      MCU sleeps until the LPTIMER deadline, interrupts still run
+*******************************************************************************/
 void Delay_ms(uint16_t delayCnt)
 {
-    tick = delayCnt;
-    while(tick);
+    TK_Start(TK_ID_DELAY, delayCnt, 0);
+    TK_Sleep_Until(TK_ID_DELAY);
+}
+
+/*******************************************************************************
+* Function   :      Get_Time_ms
+* Parameter  :      void
+* Returns    :      uint32_t
+* Description:      ms since BSP_Init, LPTIMER based
+* Note:      :      counts in deep sleep too
+*******************************************************************************/
+uint32_t Get_Time_ms(void)
+{
+    return TK_Get_Ms();
 }
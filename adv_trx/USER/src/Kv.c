@@ -0,0 +1,345 @@
+/**
+  ******************************************************************************
+  * @file    :Kv.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :wear leveled key-value store in flash, see Kv.h
+  ******************************************************************************
+***/
+
+/* Includes ------------------------------------------------------------------*/
+#include "Includes.h"
+
+
+/* Private define ------------------------------------------------------------*/
+#define KV_MAGIC            0x4B56      //sector header low half, seq high half
+#define KV_BLANK            0xFFFFFFFFUL
+#define KV_SECTOR_ADDR(s)   (KV_BASE + (uint32_t)(s)*FLASH_SECTOR_SIZE)
+#define KV_WORDS(len)       (((uint32_t)(len) + 3) & ~3UL)
+
+#define KV_HDR(key, len, crc)   ((key) | ((uint32_t)(len) << 8) | ((uint32_t)(crc) << 16))
+#define KV_HDR_KEY(hdr)     ((uint8_t)(hdr))
+#define KV_HDR_LEN(hdr)     ((uint8_t)((hdr) >> 8))
+#define KV_HDR_CRC(hdr)     ((uint16_t)((hdr) >> 16))
+
+/* Private variables ---------------------------------------------------------*/
+static uint16_t kv_index[KV_KEY_MAX];   //record offset from KV_BASE, 0: not set
+static uint8_t kv_active;               //sector written to
+static uint16_t kv_seq;                 //its header seq
+static uint32_t kv_free;                //next record address in kv_active
+
+
+/*******************************************************************************
+* Function   :     	KV_Word
+* Parameter  :     	uint32_t addr
+* Returns    :     	uint32_t
+* Description:      read a flash word
+* Note:      :
+*******************************************************************************/
+static uint32_t KV_Word(uint32_t addr)
+{
+    return *(const volatile uint32_t *)addr;
+}
+
+/*******************************************************************************
+* Function   :     	KV_Crc
+* Parameter  :     	uint8_t key, uint8_t len, const uint8_t *data
+* Returns    :     	uint16_t
+* Description:      record CRC-16 over key, len, data
+* Note:      :
+*******************************************************************************/
+static uint16_t KV_Crc(uint8_t key, uint8_t len, const uint8_t *data)
+{
+    CRC_Ctx16TypeDef ctx;
+    uint8_t head[2];
+
+    head[0] = key;
+    head[1] = len;
+    CRC_StreamInit16(&ctx);
+    CRC_StreamUpdate16(&ctx, head, 2);
+    CRC_StreamUpdate16(&ctx, data, len);
+    return CRC_StreamFinal16(&ctx);
+}
+
+/*******************************************************************************
+* Function   :     	KV_Sector_Valid
+* Parameter  :     	uint8_t s
+* Returns    :     	uint8_t, 1: sector s carries a header
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t KV_Sector_Valid(uint8_t s)
+{
+    return ((KV_Word(KV_SECTOR_ADDR(s)) & 0xFFFF) == KV_MAGIC);
+}
+
+/*******************************************************************************
+* Function   :     	KV_Sector_Blank
+* Parameter  :     	uint8_t s
+* Returns    :     	uint8_t, 1: sector s is erased
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t KV_Sector_Blank(uint8_t s)
+{
+    uint32_t addr;
+
+    for(addr = KV_SECTOR_ADDR(s); addr < KV_SECTOR_ADDR(s+1); addr += 4){
+        if(KV_Word(addr) != KV_BLANK) return 0;
+    }
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	KV_Sector_Open
+* Parameter  :     	uint8_t s, uint16_t seq
+* Returns    :     	void
+* Description:      make erased sector s the active one
+* Note:      :
+*******************************************************************************/
+static void KV_Sector_Open(uint8_t s, uint16_t seq)
+{
+    FLASH_ProgramWord(KV_SECTOR_ADDR(s), KV_MAGIC | ((uint32_t)seq << 16));
+    kv_active = s;
+    kv_seq = seq;
+    kv_free = KV_SECTOR_ADDR(s) + 4;
+}
+
+/*******************************************************************************
+* Function   :     	KV_Scan
+* Parameter  :     	uint8_t s
+* Returns    :     	uint32_t, address after the last record
+* Description:      index the records of sector s, later ones win
+* Note:      :      a broken header ends the sector, bad CRCs are skipped
+*******************************************************************************/
+static uint32_t KV_Scan(uint8_t s)
+{
+    uint32_t addr = KV_SECTOR_ADDR(s) + 4;
+    uint32_t end = KV_SECTOR_ADDR(s+1);
+    uint32_t hdr;
+    uint8_t key;
+    uint8_t len;
+
+    while(addr < end)
+    {
+        hdr = KV_Word(addr);
+        if(hdr == KV_BLANK) return addr;
+
+        key = KV_HDR_KEY(hdr);
+        len = KV_HDR_LEN(hdr);
+        if((key >= KV_KEY_MAX) || (len > KV_VAL_MAX) || (addr + 4 + KV_WORDS(len) > end)){
+            return end;     //not ours, write no more here
+        }
+
+        if(KV_HDR_CRC(hdr) == KV_Crc(key, len, (const uint8_t *)(addr + 4))){
+            kv_index[key] = len ? (uint16_t)(addr - KV_BASE) : 0;
+        }
+        addr += 4 + KV_WORDS(len);
+    }
+    return end;
+}
+
+/*******************************************************************************
+* Function   :     	KV_Live
+* Parameter  :     	uint8_t skip, key left out
+* Returns    :     	uint32_t, bytes of the indexed records, headers included
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint32_t KV_Live(uint8_t skip)
+{
+    uint32_t live = 0;
+    uint8_t key;
+
+    for(key = 0; key < KV_KEY_MAX; key++)
+    {
+        if(kv_index[key] && (key != skip)) live += 4 + KV_WORDS(KV_HDR_LEN(KV_Word(KV_BASE + kv_index[key])));
+    }
+    return live;
+}
+
+/*******************************************************************************
+* Function   :     	KV_Append
+* Parameter  :     	uint8_t key, const uint8_t *data, uint8_t len
+* Returns    :     	void
+* Description:      program a record at kv_free and index it
+* Note:      :      caller checked the space. header first: cut short, it
+*                   still gives the length to skip the rest
+*******************************************************************************/
+static void KV_Append(uint8_t key, const uint8_t *data, uint8_t len)
+{
+    uint32_t addr = kv_free;
+
+    FLASH_ProgramWord(addr, KV_HDR(key, len, KV_Crc(key, len, data)));
+    FLASH_ProgramBuffer(addr + 4, data, len, FLASH_BUFFER_WRITE);
+
+    kv_index[key] = len ? (uint16_t)(addr - KV_BASE) : 0;
+    kv_free = addr + 4 + KV_WORDS(len);
+}
+
+/*******************************************************************************
+* Function   :     	KV_Reclaim
+* Parameter  :     	uint8_t s
+* Returns    :     	void
+* Description:      copy the live records of sector s to kv_active, erase s
+* Note:      :      they fit: kv_active is fresh, or holds the ones already
+*                   copied before a reset, and all live records fit one sector
+*******************************************************************************/
+static void KV_Reclaim(uint8_t s)
+{
+    uint32_t addr;
+    uint32_t hdr;
+    uint8_t key;
+
+    for(key = 0; key < KV_KEY_MAX; key++)
+    {
+        if(kv_index[key] == 0) continue;
+        addr = KV_BASE + kv_index[key];
+        if((addr < KV_SECTOR_ADDR(s)) || (addr >= KV_SECTOR_ADDR(s+1))) continue;
+
+        hdr = KV_Word(addr);
+        KV_Append(key, (const uint8_t *)(addr + 4), KV_HDR_LEN(hdr));
+    }
+    FLASH_EraseSector(KV_SECTOR_ADDR(s));
+}
+
+/*******************************************************************************
+* Function   :     	KV_Next_Sector
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      move on to the erased sector, reclaim the oldest behind it
+* Note:      :      a reset in between is finished by KV_Init
+*******************************************************************************/
+static void KV_Next_Sector(void)
+{
+    uint8_t oldest;
+
+    KV_Sector_Open((kv_active + 1) % KV_SECTORS, kv_seq + 1);
+
+    oldest = (kv_active + 1) % KV_SECTORS;
+    if(!KV_Sector_Blank(oldest)){  //blank until the area wrapped once
+        KV_Reclaim(oldest);
+    }
+}
+
+/*******************************************************************************
+* Function   :     	KV_Init
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      find the active sector, rebuild the index
+* Note:      :      formats the area if no sector is valid
+*******************************************************************************/
+void KV_Init(void)
+{
+    uint8_t s;
+    uint8_t i;
+    uint8_t found = 0;
+    uint16_t seq;
+
+    memset(kv_index, 0, sizeof(kv_index));
+
+    for(s = 0; s < KV_SECTORS; s++)
+    {
+        if(!KV_Sector_Valid(s)) continue;
+        seq = (uint16_t)(KV_Word(KV_SECTOR_ADDR(s)) >> 16);
+        if(!found || ((int16_t)(seq - kv_seq) > 0)){
+            kv_active = s;
+            kv_seq = seq;
+            found = 1;
+        }
+    }
+
+    if(!found){
+        for(s = 0; s < KV_SECTORS; s++){
+            if(!KV_Sector_Blank(s)) FLASH_EraseSector(KV_SECTOR_ADDR(s));
+        }
+        KV_Sector_Open(0, 1);
+        return;
+    }
+
+    //oldest first, the active sector last
+    for(i = 1; i <= KV_SECTORS; i++)
+    {
+        s = (kv_active + i) % KV_SECTORS;
+        if(KV_Sector_Valid(s)){
+            kv_free = KV_Scan(s);
+        }
+    }
+
+    //the sector after the active one must be erased: finish a reclaim
+    s = (kv_active + 1) % KV_SECTORS;
+    if(!KV_Sector_Blank(s)){
+        KV_Reclaim(s);
+    }
+}
+
+/*******************************************************************************
+* Function   :     	KV_Get
+* Parameter  :     	uint8_t key, void *buf, uint8_t max
+* Returns    :     	uint8_t, value length, 0: not set
+* Description:      copy up to max bytes of the value to buf
+* Note:      :
+*******************************************************************************/
+uint8_t KV_Get(uint8_t key, void *buf, uint8_t max)
+{
+    uint32_t addr;
+    uint8_t len;
+
+    if((key >= KV_KEY_MAX) || (kv_index[key] == 0)) return 0;
+
+    addr = KV_BASE + kv_index[key];
+    len = KV_HDR_LEN(KV_Word(addr));
+    memcpy(buf, (const uint8_t *)(addr + 4), (len < max) ? len : max);
+    return len;
+}
+
+/*******************************************************************************
+* Function   :     	KV_Set
+* Parameter  :     	uint8_t key, const void *data, uint8_t len, 0..KV_VAL_MAX
+* Returns    :     	uint8_t, 1: stored, 0: bad key/len or no space
+* Description:      store a value, nothing is written if it is unchanged
+* Note:      :      main loop, radio idle: the CPU stalls while flash is busy,
+*                   a sector erase takes ms. len 0 deletes. no space: the live
+*                   records with the new value would pass KV_LIVE_MAX
+*******************************************************************************/
+uint8_t KV_Set(uint8_t key, const void *data, uint8_t len)
+{
+    uint32_t addr;
+    uint8_t tries;
+
+    if((key >= KV_KEY_MAX) || (len > KV_VAL_MAX)) return 0;
+
+    if(kv_index[key]){
+        addr = KV_BASE + kv_index[key];
+        if((KV_HDR_LEN(KV_Word(addr)) == len) && !memcmp((const uint8_t *)(addr + 4), data, len)){
+            return 1;
+        }
+    }else if(len == 0){
+        return 1;
+    }
+
+    //refused up front, before any sector is erased for it
+    if(KV_Live(key) + 4 + KV_WORDS(len) > KV_LIVE_MAX) return 0;
+
+    for(tries = 0; kv_free + 4 + KV_WORDS(len) > KV_SECTOR_ADDR(kv_active + 1); tries++)
+    {
+        if(tries >= KV_SECTORS - 1) return 0;   //live values fill the area
+        KV_Next_Sector();
+    }
+
+    KV_Append(key, (const uint8_t *)data, len);
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	KV_Del
+* Parameter  :     	uint8_t key
+* Returns    :     	uint8_t, 1: done
+* Description:      remove key, KV_Get returns 0 after this
+* Note:      :      see KV_Set
+*******************************************************************************/
+uint8_t KV_Del(uint8_t key)
+{
+    return KV_Set(key, 0, 0);
+}
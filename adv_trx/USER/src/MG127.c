@@ -13,7 +13,20 @@
 
 
 /* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+    BLE_STATE_IDLE = 0,     //power down, MCU can deep sleep
+    BLE_STATE_SLEEP,        //BLE sleeps, wakes itself for the next adv event
+    BLE_STATE_WAKEUP,       //wakeup sent, wait INT_TYPE_WAKEUP
+    BLE_STATE_TRX,          //tx/rx started, wait INT_TYPE_SLEEP
+}BLE_StateTypeDef;
+
 /* Private define ------------------------------------------------------------*/
+//ble_stage: BLE registers that no longer hold what BLE_Start() wants
+#define BLE_STAGE_ADV       0x01    //BLT FIFO adv_data
+#define BLE_STAGE_HDR       0x02    //ADV_HDR_TX
+#define BLE_STAGE_INT       0x04    //INT_FLAG clear/mask
+#define BLE_STAGE_ALL       0x07
 
 
 
@@ -22,9 +35,48 @@
 
 
 /* Private variables ---------------------------------------------------------*/
-extern unsigned short tick;
+static volatile uint8_t ble_state = BLE_STATE_IDLE;
+static uint8_t ble_txcnt;                  //tx/rx left in this adv event
+static uint8_t ble_rxcnt;
+static uint8_t ble_ch;
+static uint16_t ble_interval = 0;          //ms, 0: one adv event per BLE_Start()
+static uint32_t ble_evt_start;             //TB_Get_Us() at adv event start
+static uint32_t ble_rx_wake;               //TB_Get_Us() at rx wakeup
+static uint8_t ble_rx_on = 0;              //rx window open, see RxWin.c
+static uint8_t ble_rxgot;                  //wanted PDUs in this adv event
+
+//what the BLE holds: FIFO, header, channel. only changes are written
+static uint8_t ble_stage = BLE_STAGE_ALL;
+static uint8_t ble_adv_buf[LEN_DATA];
+static uint8_t ble_adv_len = LEN_DATA;
+static uint8_t ble_adv_hdr[2] = {ADV_NONCONN_IND, LEN_DATA+LEN_BLE_ADDR};
+static uint8_t ble_int_clr[2] = {0xFF, 0x80};   //INT_FLAG: clear all
+static BLE_PduTypeDef ble_pdu_full;     //read into when the rx ring is full
+static uint8_t ble_ch_reg = 0;  //CH_NO, 0: unknown
+
+//conditions of the last calibration, see BLE_CAL_ in Ble.h
+static uint8_t ble_cal_valid = 0;
+static uint32_t ble_cal_ms;                 //TK_Get_Ms() then
+static uint16_t ble_cal_vdd;                //mV, 0: unknown
+static int8_t ble_cal_temp;                 //deg C
+static uint8_t ble_cal_env;                 //1: temp known then
+static uint16_t ble_env_vdd = 0;            //latest BLE_Cal_Env
+static int8_t ble_env_temp = 0;
+static uint8_t ble_env_set = 0;             //1: BLE_Cal_Env called
+static uint32_t ble_cal_done = 0;
+static uint32_t ble_cal_skip = 0;
+static BLE_CalThrTypeDef ble_cal_thr = {BLE_CAL_MAX_MS, BLE_CAL_VDD_MV, BLE_CAL_TEMP_C, 0};
+
+//idle power, see BLE_RETAIN_MS in Ble.h
+static uint32_t ble_retain_ms = BLE_RETAIN_MS;
+static uint8_t ble_retained = 0;            //idle in light sleep, not powered down
+static uint8_t ble_started = 0;             //1: BLE_Start() ran, ble_start_ms valid
+static uint32_t ble_start_ms = 0;           //TK_Get_Ms() at the last BLE_Start()
+static uint32_t ble_start_gap = 0;          //ms between the last two, 0: unknown
+static uint32_t ble_next_ms = 0;            //BLE_Set_NextStart, 0: use ble_start_gap
+static uint32_t ble_wake_cold = 0;
+static uint32_t ble_wake_warm = 0;
 
-unsigned char rx_buf[39]; //include header(2B)+mac(6B)+data(max31B), for rx application
 
 //BLE ADV_data, maxlen=31
 //#define LEN_DATA 31
@@ -32,8 +84,133 @@ uint8_t adv_data[31] = {0x02,0x01,0x04, 0x1a,0xff,0x4c,0x00,2,0x15, 0xfd,0xa5,0x
 
 unsigned char * const TxgainPt=(unsigned char *)0x18000040;
 
+/* Register sequences: {len, cmd, data[len]}, see SPI_Write_Seq() */
+static const uint8_t ble_seq_sleep[] = {
+    SEQ_BANK(BANK_56),
+    SEQ_BUF(SLEEP_WAKEUP, 4), 0x02, 0xff, 0xff, 0xff,
+    SEQ_END
+};
+
+static const uint8_t ble_seq_pwrup[] = {
+    SEQ_BANK(BANK_51),
+    SEQ_REG(0x20, 0x7a), //pwr up
+
+    SEQ_BANK(BANK_53),
+    SEQ_REG(0x35, 0x01), //tm
+    SEQ_BUF(0x13, 2), 0x01, 0x20, //undo pwr down, as after ble_seq_cal_tx
+    SEQ_REG(0x35, 0x00),
+    SEQ_REG(0x3d, 0x1e),
+
+    SEQ_REG(0x37, 0x88), //csn
+    SEQ_REG(0x38, 0x88), //sck
+    SEQ_REG(0x39, 0x88), //mosi
+    SEQ_END
+};
+
+static const uint8_t ble_seq_pwrdn[] = {
+    SEQ_BANK(BANK_51),
+    SEQ_REG(0x20, 0x78), //pwr down
+
+    SEQ_BANK(BANK_53),
+    SEQ_REG(0x3d, 0x18),
+    SEQ_REG(0x35, 0x01), //tm
+
+    SEQ_REG(0x37, 0x8e), //csn pu
+    SEQ_REG(0x38, 0x8c), //sck pd
+    SEQ_REG(0x39, 0x8c), //mosi pd
+
+    SEQ_BUF(0x13, 2), 0x81, 0x02,
+    SEQ_REG(0x3e, 0xa0),
+
+    SEQ_BANK(BANK_56),
+    SEQ_END
+};
+
+static const uint8_t ble_seq_cal_tx[] = {
+    SEQ_REG(0x35, 0x01), //testm for tx/temp
+    SEQ_REG(0x32, 0xA0),
+    SEQ_REG(0x2a, 0x04),
+    SEQ_REG(0x2a, 0x00),
+
+    SEQ_REG(0x32, 0x88),
+    SEQ_BUF(0x13, 2), 0x01, 0x21,
+    SEQ_BUF(0x13, 2), 0x01, 0x20,
+    SEQ_REG(0x35, 0x00), //exist testm
+    SEQ_END
+};
+
+static const uint8_t ble_seq_reset[] = {
+    SEQ_BANK(BANK_51),
+    SEQ_BANK(BANK_53),
+    SEQ_REG(0x35, 0x00),
+    SEQ_REG(0x36, 0x8c), //ce=L
+    SEQ_REG(0x3D, 0x18),
+    SEQ_BANK(BANK_51),
+    SEQ_END
+};
+
+static const uint8_t ble_seq_probe[] = {
+    SEQ_BANK(BANK_53),
+
+    SEQ_BUF(0x00, 3), 0x00, 0x00, 0x01,
+
+    SEQ_REG(0x36, 0x8e),
+    SEQ_REG(0x37, 0x88),
+    SEQ_REG(0x38, 0x88),
+    SEQ_REG(0x39, 0x8e),
+
+    SEQ_BANK(BANK_51),
+    SEQ_END
+};
+
+static const uint8_t ble_seq_hot_reset[] = {
+    SEQ_REG(0x20, 0x78), //power down,tx, for hot reset
+    SEQ_REG(0x26, 0x06), //1Mbps
+    SEQ_REG(0x20, 0x7a), //power up
+
+    SEQ_BANK(BANK_56),
+    SEQ_BUF(SLEEP_WAKEUP, 4), 0x02, 0xff, 0xff, 0xff, //sleep
+    SEQ_END
+};
+
+static const uint8_t ble_seq_tx_cfg[] = {
+    SEQ_BANK(BANK_53),
+
+    SEQ_BUF(0x14, 2), 0x7f, 0x80, //xocc
+
+    //set BLE TX Power
+    SEQ_BUF(0x0f, 3), 0x02, BLE_TX_POWER, 0x52,
+    SEQ_END
+};
+
+static const uint8_t ble_seq_rx_cfg[] = {
+    SEQ_BUF(0x0C, 2), 0x80, 0x00, //rx
+
+    SEQ_BUF(0x13, 2), 0x81, 0x22,
+
+    SEQ_REG(0x21, 0x02),
+    SEQ_REG(0x3C, 0x00),
+    SEQ_REG(0x3E, 0x30),
+
+    SEQ_BUF(0x02, 3), 0x38, 0x0F, 0x00, //gc
+
+    SEQ_BUF(0x0b, 4), 0x80, 0x70, 0x21, 0x40, //gain, rx
+
+    SEQ_REG(0x29, 0x71), //gain
+
+    SEQ_BUF(0x0A, 2), 0x10, 0x02,
+    SEQ_BUF(0x0D, 2), 0x02, 0x12,
+    SEQ_BUF(0x0E, 2), 0x01, 0x07,
+
+    SEQ_BANK(BANK_56),
+    SEQ_REG(0x20, 0x01),
+    SEQ_END
+};
+
 /* Private function prototypes -----------------------------------------------*/
 void BLE_Do_Cal(void);
+static uint8_t BLE_Cal_Needed(void);
+static void BLE_Power_Idle(void);
 
 
 /*******************************************************************************
@@ -45,14 +222,7 @@ void BLE_Do_Cal(void);
 *******************************************************************************/
 void BLE_Mode_Sleep(void)
 {
-    uint8_t	temp0[4] = {0x02, 0xff, 0xff, 0xff};
-
-    //temp0[0] = 0x02;
-    //temp0[1] = 0xff;
-    //temp0[2] = 0xff;
-    //temp0[3] = 0xff;
-
-    SPI_Write_Buffer(SLEEP_WAKEUP,temp0,4);
+    SPI_Write_Seq(ble_seq_sleep);
 }
 
 /*******************************************************************************
@@ -64,52 +234,151 @@ void BLE_Mode_Sleep(void)
 *******************************************************************************/
 void BLE_Mode_Wakeup(void)
 {
+    SPI_Select_Bank(BANK_56);
     SPI_Write_Reg(SLEEP_WAKEUP|0x20, 0x01);
 }
 
-
-void BLE_Mode_PwrUp(void)
+/*******************************************************************************
+* Function   :     	BLE_Mode_SleepWake
+* Parameter  :     	uint32_t wake_lf, 1..BLE_WAKE_NEVER, unit: LFCLK_1MS
+* Returns    :     	void
+* Description:      BLE enter sleep mode and wake itself after wake_lf
+* Note:      : 		INT_TYPE_WAKEUP when it wakes, no SPI wakeup needed
+*******************************************************************************/
+void BLE_Mode_SleepWake(uint32_t wake_lf)
 {
-    SPI_Write_Reg(0X50, 0x51);
-    SPI_Write_Reg(0X20, 0x7a); //pwr up
+    uint8_t temp0[4];
+
+    temp0[0] = 0x02;
+    temp0[1] = wake_lf & 0xff;
+    temp0[2] = (wake_lf >> 8) & 0xff;
+    temp0[3] = (wake_lf >> 16) & 0xff;
 
-    SPI_Write_Reg(0x50, 0x53);
-    SPI_Write_Reg(0X35, 0x00);
-    SPI_Write_Reg(0x3d, 0x1e);
+    SPI_Select_Bank(BANK_56);
+    SPI_Write_Buffer(SLEEP_WAKEUP, temp0, 4);
+}
 
-    SPI_Write_Reg(0x37, 0x88); //csn 
-    SPI_Write_Reg(0x38, 0x88); //sck 
-    SPI_Write_Reg(0x39, 0x88); //mosi 
 
+void BLE_Mode_PwrUp(void)
+{
+    SPI_Write_Seq(ble_seq_pwrup);
     BLE_Do_Cal();
-    SPI_Write_Reg(0x50, 0x56);
     BLE_Mode_Sleep();
+    TB_Radio_On();
 }
 
 
 void BLE_Mode_PwrDn(void)
 {
-    unsigned char temp[2] = {0x81, 0x02};
+    TB_Radio_Off();
+    SPI_Write_Seq(ble_seq_pwrdn);
+}
 
-    SPI_Write_Reg(0X50, 0x51);
-    SPI_Write_Reg(0X20, 0x78); //pwr down
 
-    SPI_Write_Reg(0X50, 0x53);
-    SPI_Write_Reg(0x3d, 0x18);
-    SPI_Write_Reg(0X35, 0x01);  //tm
-    
-    SPI_Write_Reg(0x37, 0x8e); //csn pu
-    SPI_Write_Reg(0x38, 0x8c); //sck pd
-    SPI_Write_Reg(0x39, 0x8c); //mosi pd
+/*******************************************************************************
+* Function   :     	BLE_Set_AdvData
+* Parameter  :     	const uint8_t *data, uint8_t len
+* Returns    :     	void
+* Description:      set adv_data and its length, max LEN_DATA
+* Note:      :      adv_data may also be changed in place, BLE_Start() sees it
+*******************************************************************************/
+void BLE_Set_AdvData(const uint8_t *data, uint8_t len)
+{
+    if(len > LEN_DATA) len = LEN_DATA;
+
+    memcpy(adv_data, data, len);
+    if(len != ble_adv_len){
+        ble_adv_len = len;
+        ble_adv_hdr[1] = len + LEN_BLE_ADDR;
+        ble_stage |= BLE_STAGE_ADV|BLE_STAGE_HDR;
+    }
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Set_AdvType
+* Parameter  :     	uint8_t type, ADV_IND ... ADV_SCAN_IND, tx addr bit
+* Returns    :     	void
+* Description:      first byte of the tx PDU header
+* Note:      :      default ADV_NONCONN_IND
+*******************************************************************************/
+void BLE_Set_AdvType(uint8_t type)
+{
+    if(type != ble_adv_hdr[0]){
+        ble_adv_hdr[0] = type;
+        ble_stage |= BLE_STAGE_HDR;
+    }
+}
 
-    //temp[0] = 0x81;
-    //temp[1] = 0x02;
-    SPI_Write_Buffer(0x13, temp, 2);
-    SPI_Write_Reg(0X3e, 0xa0);
+/*******************************************************************************
+* Function   :     	BLE_Set_Channel
+* Parameter  :     	uint8_t ch
+* Returns    :     	void
+* Description:      set CH_NO, skipped if BLE already has it
+* Note:      :
+*******************************************************************************/
+void BLE_Set_Channel(uint8_t ch)
+{
+    if(ch != ble_ch_reg){
+        ble_ch_reg = ch;
+        SPI_Select_Bank(BANK_56);
+        SPI_Write_Reg(CH_NO|0X20, ch);
+    }
+}
 
-    SPI_Write_Reg(0X50, 0x56);
+/*******************************************************************************
+* Function   :     	BLE_Stage_Write
+* Parameter  :     	uint8_t reg, uint8_t *buf, uint8_t len
+* Returns    :     	void
+* Description:      BANK_56 register write, queued if BLE_STAGE_ASYNC
+* Note:      :      blocking if the queue is full. buf must stay as it is until
+*                   the write is done
+*******************************************************************************/
+static void BLE_Stage_Write(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+#if BLE_STAGE_ASYNC
+    SPI_XferTypeDef xfer;
+
+    xfer.reg = reg;
+    xfer.dir = SPI_DIR_WRITE;
+    xfer.len = len;
+    xfer.buf = buf;
+    xfer.bank = BANK_56;
+    xfer.done = 0;
+    if(SPI_Async_Submit(&xfer)) return;
+#endif
+    SPI_Select_Bank(BANK_56);
+    SPI_Write_Buffer(reg, buf, len);
 }
 
+/*******************************************************************************
+* Function   :     	BLE_Stage_Commit
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      write adv_data, header, interrupt setup if they changed
+* Note:      :      BLE_STAGE_ASYNC: returns with the writes queued, the next
+*                   blocking SPI call waits for them.
+*                   BLT FIFO keeps adv_data over BLE_Mode_PwrDn()
+*******************************************************************************/
+static void BLE_Stage_Commit(void)
+{
+    if((ble_stage & BLE_STAGE_ADV) || memcmp(ble_adv_buf, adv_data, ble_adv_len)){
+        //BLT FIFO write adv_data . max len:31 byte, sent from the copy
+        memcpy(ble_adv_buf, adv_data, ble_adv_len);
+        BLE_Stage_Write(W_TX_PAYLOAD, ble_adv_buf, ble_adv_len);
+    }
+
+    if(ble_stage & BLE_STAGE_HDR){
+        //PDU TYPE: 2  non-connectable undirected advertising . tx add:random address
+        //set BLT PDU length:adv_data+6 mac adress.
+        BLE_Stage_Write(ADV_HDR_TX, ble_adv_hdr, 2);
+    }
+
+    if(ble_stage & BLE_STAGE_INT){
+        BLE_Stage_Write(INT_FLAG, ble_int_clr, 2);
+    }
+
+    ble_stage = 0;
+}
 
 /*******************************************************************************
 * Function   :     	BLE_Set_StartTime
@@ -126,6 +395,7 @@ void BLE_Set_StartTime(uint32_t htime)
     temp0[1] = (htime>>8) & 0xFF;
     temp0[2] = (htime>>16) & 0xFF;
 
+    SPI_Select_Bank(BANK_56);
     SPI_Write_Buffer(START_TIME,temp0,3);
 }
 
@@ -145,78 +415,92 @@ void BLE_Set_TimeOut(uint32_t data_us)
     temp0[1] = (data_us >> 8) & 0xff;
     temp0[2] = (data_us >> 16) & 0xff;
 
+    SPI_Select_Bank(BANK_56);
     SPI_Write_Buffer(TIMEOUT, temp0, 3);
 }
 
-/*called when pdu received, 1dB*/
+/*called when pdu received, 1dB. bank stays BANK_53, BANK_56 users reselect*/
 uint8_t BLE_Get_RSSI(void)
 {
-    uint8_t rssi = 0;
-    SPI_Write_Reg(0x50, 0x53);
-    rssi = SPI_Read_Reg(0x04);
-    SPI_Write_Reg(0x50, 0x56);
-    return rssi;
+    SPI_Select_Bank(BANK_53);
+    return SPI_Read_Reg(0x04);
 }
 
-void BLE_Get_Pdu(uint8_t *ptr, uint8_t *len)
+/*******************************************************************************
+* Function   :     	BLE_Read_Pdu_Head
+* Parameter  :     	BLE_PduTypeDef *pdu
+* Returns    :     	uint8_t, 1: adv PDU with advA, 0: header only
+* Description:      read header and advA of the received PDU, payload left in BLE
+* Note:      :      pdu->len: payload bytes BLE_Read_Pdu_Data() will read
+*******************************************************************************/
+uint8_t BLE_Read_Pdu_Head(BLE_PduTypeDef *pdu)
 {
-    uint8_t hdr_type;
     uint8_t len_tmp;
-    uint8_t bank_buf[6];
 
-    SPI_Read_Buffer(ADV_HDR_RX, bank_buf, 2);
+    SPI_Select_Bank(BANK_56);
+    SPI_Read_Buffer(ADV_HDR_RX, pdu->hdr, 2);
 
-    *len = bank_buf[1] + 2;
-    ptr[0] = bank_buf[0];
-    ptr[1] = bank_buf[1];
+    pdu->ch = ble_ch_reg;
+    pdu->len = 0;
+    len_tmp = pdu->hdr[1];
 
-    hdr_type = bank_buf[0] & 0xF;
-    len_tmp = bank_buf[1];
-    switch(hdr_type){
+    switch(pdu->hdr[0] & 0xF){
         case ADV_IND:  //advA+0~31
         case ADV_NONCONN_IND:
         case ADV_SCAN_IND:
         //case ADV_SCAN_RSP:
-            SPI_Read_Buffer(INITA_RX, &ptr[2], LEN_BLE_ADDR);  //INITA
+            if(len_tmp < LEN_BLE_ADDR) break;
+            SPI_Read_Buffer(INITA_RX, pdu->addr, LEN_BLE_ADDR);  //INITA
             len_tmp -= LEN_BLE_ADDR;
-            break;
+
+            if(len_tmp <= LEN_DATA){
+                pdu->len = len_tmp;
+            }
+            return 1;
 /*
         case ADV_DIRECT_IND:  //advA+InitA
-            if(len_tmp == 12){
-                SPI_Read_Buffer(ADVA_RX, &ptr[2], LEN_BLE_ADDR);  //advA
-                len_tmp -= LEN_BLE_ADDR;
-                SPI_Read_Buffer(INITA_RX, &ptr[2+LEN_BLE_ADDR], LEN_BLE_ADDR);  //INITA
-                len_tmp -= LEN_BLE_ADDR;
-            }
-            len_tmp = 0;
-            break;
         case ADV_SCAN_REQ:  //scanA + advA
-            if(len_tmp == 12){
-                SPI_Read_Buffer(INITA_RX, &ptr[2], LEN_BLE_ADDR);  //INITA
-                len_tmp -= LEN_BLE_ADDR;
-                SPI_Read_Buffer(ADVA_RX, &ptr[2+LEN_BLE_ADDR], LEN_BLE_ADDR);  //advA
-                len_tmp -= LEN_BLE_ADDR;
-            }
-            len_tmp = 0;
-            break;
+            12B: ADVA_RX, INITA_RX
         case ADV_CONN_REQ:  //InitA + advA + LL(22B)
-            if(len_tmp == 34){
-                SPI_Read_Buffer(INITA_RX, &ptr[2], LEN_BLE_ADDR);  //INITA
-                SPI_Read_Buffer(ADVA_RX, &ptr[2+LEN_BLE_ADDR], LEN_BLE_ADDR);  //advA
-                SPI_Read_Buffer(R_RX_PAYLOAD, &ptr[2+LEN_BLE_ADDR+LEN_BLE_ADDR], 22);
-            }
-            len_tmp = 0;
-            break;
+            34B: INITA_RX, ADVA_RX, R_RX_PAYLOAD(22B)
 */
         default:
-            len_tmp = 0;
             break;
     }
 
-    if(len_tmp > 0){
-        if(len_tmp <= 31)
-            SPI_Read_Buffer(R_RX_PAYLOAD, &ptr[2+LEN_BLE_ADDR], len_tmp);
+    return 0;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Read_Pdu_Data
+* Parameter  :     	BLE_PduTypeDef *pdu, after BLE_Read_Pdu_Head
+* Returns    :     	void
+* Description:      read payload and rssi of the received PDU
+* Note:      :      rssi last, bank stays BANK_53
+*******************************************************************************/
+void BLE_Read_Pdu_Data(BLE_PduTypeDef *pdu)
+{
+    if(pdu->len > 0){
+        SPI_Select_Bank(BANK_56);
+        SPI_Read_Buffer(R_RX_PAYLOAD, pdu->data, pdu->len);
     }
+    pdu->rssi = BLE_Get_RSSI();
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Read_Pdu
+* Parameter  :     	BLE_PduTypeDef *pdu
+* Returns    :     	uint8_t, 1: adv PDU with advA, 0: header only
+* Description:      read header, advA, payload and rssi of the received PDU
+* Note:      :      called when pdu received
+*******************************************************************************/
+uint8_t BLE_Read_Pdu(BLE_PduTypeDef *pdu)
+{
+    uint8_t ret;
+
+    ret = BLE_Read_Pdu_Head(pdu);
+    BLE_Read_Pdu_Data(pdu);
+    return ret;
 }
 
 
@@ -224,34 +508,88 @@ void BLE_Get_Pdu(uint8_t *ptr, uint8_t *len)
 
 void BLE_Do_Cal()  //calibration
 {
-    uint8_t data_buf[2];
+    uint8_t loop;
 
-    SPI_Write_Reg(0x3F, 0x03);
-    do{
-        data_buf[0] = SPI_Read_Reg(0x1F);
-    }while(data_buf[0]&0x03);
+    for(loop=0; loop<2; loop++){
+        SPI_Write_Reg(0x3F, 0x03);
+        while(SPI_Read_Reg(0x1F)&0x03);
+    }
 
-    SPI_Write_Reg(0x3F, 0x03);
-    do{
-        data_buf[0] = SPI_Read_Reg(0x1F);
-    }while(data_buf[0]&0x03);
+    SPI_Write_Seq(ble_seq_cal_tx);
+
+    ble_cal_valid = 1;
+    ble_cal_ms = TK_Get_Ms();
+    ble_cal_vdd = ble_env_vdd;
+    ble_cal_temp = ble_env_temp;
+    ble_cal_env = ble_env_set;
+    ble_cal_done++;
+    TRACE_U32(TR_ID_CAL, ble_cal_done, ble_cal_skip);
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Cal_Needed
+* Parameter  :     	void
+* Returns    :     	uint8_t, 1: calibrate
+* Description:      drift since the last calibration over ble_cal_thr
+* Note:      :      supply/temperature only if BLE_Cal_Env gave them
+*******************************************************************************/
+static uint8_t BLE_Cal_Needed(void)
+{
+    int16_t diff;
+
+    if(!ble_cal_valid) return 1;
 
-    //////////////////////////////////////////////////
-    SPI_Write_Reg(0x35,0x01); //testm for tx/temp
-    SPI_Write_Reg(0x32,0xA0);
-    SPI_Write_Reg(0x2a,0x04);
-    SPI_Write_Reg(0x2a,0x00);
+    if(ble_cal_thr.max_ms && ((TK_Get_Ms() - ble_cal_ms) >= ble_cal_thr.max_ms)) return 1;
 
-    SPI_Write_Reg(0x32,0x88);
-    data_buf[0] = 0x01;
-    data_buf[1] = 0x21;
-    SPI_Write_Buffer(0x13, data_buf, 2);
-    data_buf[0] = 0x01;
-    data_buf[1] = 0x20;
-    SPI_Write_Buffer(0x13, data_buf, 2);
-    SPI_Write_Reg(0x35,0x00);  //exist testm
-    ////////////////////////////////////////////////////
+    if(ble_cal_thr.vdd_mv && ble_cal_vdd && ble_env_vdd){
+        diff = (int16_t)(ble_env_vdd - ble_cal_vdd);
+        if((diff >= (int16_t)ble_cal_thr.vdd_mv) || (-diff >= (int16_t)ble_cal_thr.vdd_mv)) return 1;
+    }
+
+    if(ble_cal_thr.temp_c && ble_cal_env && ble_env_set){
+        diff = ble_env_temp - ble_cal_temp;
+        if((diff >= ble_cal_thr.temp_c) || (-diff >= ble_cal_thr.temp_c)) return 1;
+    }
+    return 0;
+}
 
+/*******************************************************************************
+* Function   :     	BLE_Cal_Env
+* Parameter  :     	uint16_t vdd_mv, 0: unknown. int8_t temp_c
+* Returns    :     	void
+* Description:      latest supply and temperature, measured by the application
+* Note:      :      checked at the next warm BLE_Start. no call: age only
+*******************************************************************************/
+void BLE_Cal_Env(uint16_t vdd_mv, int8_t temp_c)
+{
+    ble_env_vdd = vdd_mv;
+    ble_env_temp = temp_c;
+    ble_env_set = 1;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Cal_Invalidate
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      calibrate at the next BLE_Start, warm or not
+* Note:      :
+*******************************************************************************/
+void BLE_Cal_Invalidate(void)
+{
+    ble_cal_valid = 0;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Get_CalCount
+* Parameter  :     	uint32_t *done, uint32_t *skipped
+* Returns    :     	void
+* Description:      calibrations run, and warm starts that skipped one, since boot
+* Note:      :
+*******************************************************************************/
+void BLE_Get_CalCount(uint32_t *done, uint32_t *skipped)
+{
+    *done = ble_cal_done;
+    *skipped = ble_cal_skip;
 }
 
 /*******************************************************************************
@@ -264,31 +602,18 @@ void BLE_Do_Cal()  //calibration
 void BLE_Init(void)
 {
     uint8_t status;
-    uint8_t data_buf[4];
+    uint8_t data_buf[3];
+    uint8_t kv_buf[LEN_DATA];
+    uint8_t len;
     uint8_t ble_Addr[6];
 
 
-    SPI_Write_Reg(0x50, 0x51);
-    SPI_Write_Reg(0x50, 0x53);
-    SPI_Write_Reg(0x35, 0x00);
-    SPI_Write_Reg(0x36, 0x8c); //ce=L
-    SPI_Write_Reg(0x3D, 0x18);
-    SPI_Write_Reg(0x50, 0x51);
+    SPI_Reset_Bank();
+    SPI_Write_Seq(ble_seq_reset);
 
     do{
-        SPI_Write_Reg(0x50, 0x53);
-
-        data_buf[0] = 0;
-        data_buf[1] = 0;
-        data_buf[2] = 1;
-        SPI_Write_Buffer(0x00, data_buf, 3);
-
-        SPI_Write_Reg(0x36, 0x8e);
-        SPI_Write_Reg(0x37, 0x88);
-        SPI_Write_Reg(0x38, 0x88);
-        SPI_Write_Reg(0x39, 0x8e);
-
-        SPI_Write_Reg(0x50, 0x51);
+        SPI_Reset_Bank();
+        SPI_Write_Seq(ble_seq_probe);
 
         SPI_Read_Reg(0x1e);
 
@@ -298,23 +623,24 @@ void BLE_Init(void)
 #if 1 //debug
     //read chip version
     status = SPI_Read_Reg(0x1e);
+#if TRACE_ON
+    TRACE(TR_ID_CHIP, &status, 1);
+#else
     Uart_Send_String("chip version=");
     Uart_Send_Byte(status);
     Uart_Send_String("\r\n");
+#endif
 #endif
 
-    SPI_Write_Reg(0X20, 0x78);//power down,tx, for hot reset
-    SPI_Write_Reg(0X26, 0x06);//1Mbps
-    SPI_Write_Reg(0X20, 0x7a);//power up
-
-    SPI_Write_Reg(0x50, 0x56);
-
-    BLE_Mode_Sleep();
+    SPI_Write_Seq(ble_seq_hot_reset);
 
 #if 1 //debug
     //read BLE address. BLE MAC Address
     SPI_Read_Buffer(0x08, ble_Addr, 6);
 
+#if TRACE_ON
+    TRACE(TR_ID_ADDR, ble_Addr, 6);
+#else
     Uart_Send_String("BleAddr=");
     Uart_Send_Byte(ble_Addr[5]);
     Uart_Send_Byte(ble_Addr[4]);
@@ -324,19 +650,15 @@ void BLE_Init(void)
     Uart_Send_Byte(ble_Addr[0]);
     Uart_Send_String("\r\n");
 #endif
+#endif
 
 
-    SPI_Write_Reg(0x50, 0x53);
-
-    data_buf[0] = 0x7f;
-    data_buf[1] = 0x80; //xocc
-    SPI_Write_Buffer(0x14,data_buf,2);
-
-    //set BLE TX Power
-    data_buf[0] = 0x02;
-    data_buf[1] = BLE_TX_POWER;
-    data_buf[2] = 0x52;
-    SPI_Write_Buffer(0x0f,data_buf,3);
+    SPI_Write_Seq(ble_seq_tx_cfg);
+    if(KV_Get(KV_KEY_TX_POWER, &data_buf[1], 1)){ //else BLE_TX_POWER
+        data_buf[0] = 0x02;
+        data_buf[2] = 0x52;
+        SPI_Write_Buffer(0x0f, data_buf, 3);
+    }
 
     data_buf[1] = *TxgainPt;
     if((11 > data_buf[1])||(25 < data_buf[1])){
@@ -346,163 +668,513 @@ void BLE_Init(void)
     data_buf[2] = 0x2D; //rx
     SPI_Write_Buffer(0x4, data_buf, 3);
 
+    SPI_Write_Seq(ble_seq_rx_cfg);
 
-    data_buf[0] = 0x80; //rx
-    data_buf[1] = 0x00;
-    SPI_Write_Buffer(0x0C, data_buf, 2);
+    ble_stage = BLE_STAGE_ALL;
+    ble_ch_reg = 0;
+    ble_cal_valid = 0;  //new register setup, no warm start before a PwrUp
+    KV_Get(KV_KEY_CAL_THR, &ble_cal_thr, sizeof(ble_cal_thr));
 
-    data_buf[0] = 0x81;
-    data_buf[1] = 0x22;
-    SPI_Write_Buffer(0x13, data_buf, 2);
+    //stored adv settings, see Kv.h
+    len = KV_Get(KV_KEY_ADV_DATA, kv_buf, LEN_DATA);
+    if(len) BLE_Set_AdvData(kv_buf, len);
+    if(KV_Get(KV_KEY_ADV_TYPE, kv_buf, 1)) BLE_Set_AdvType(kv_buf[0]);
+}
 
-    SPI_Write_Reg(0X21, 0x02);
-    SPI_Write_Reg(0x3C, 0x00);
-    SPI_Write_Reg(0x3E, 0x30);
+/*******************************************************************************
+* Function   :     	BLE_Dump_Pdu
+* Parameter  :     	const BLE_PduTypeDef *pdu
+* Returns    :     	void
+* Description:      print PDU to uart, RX[rssi]: hdr advA data
+* Note:      :      debug, call from main loop not from interrupt.
+*                   TRACE_ON: one TR_ID_PDU frame, formatted on the host
+*******************************************************************************/
+void BLE_Dump_Pdu(const BLE_PduTypeDef *pdu)
+{
+    uint8_t loop;
+#if TRACE_ON
+    uint8_t arg[2+2+LEN_BLE_ADDR+LEN_DATA];
+
+    arg[0] = pdu->rssi;
+    arg[1] = pdu->ch;
+    for(loop=0; loop<(2+LEN_BLE_ADDR+pdu->len); loop++){
+        arg[2+loop] = pdu->hdr[loop]; //hdr, addr, data are contiguous
+    }
+    TRACE(TR_ID_PDU, arg, 2+loop);
+#else
+    Uart_Send_String("\r\nRX[");
+    Uart_Send_Byte(pdu->rssi);
+    Uart_Send_String("]: ");
+    for(loop=0; loop<(2+LEN_BLE_ADDR+pdu->len); loop++){
+        Uart_Send_Byte(pdu->hdr[loop]); //hdr, addr, data are contiguous
+        Uart_Send_String(" ");
+    }
+#endif
+}
 
-    data_buf[0] = 0x38;
-    data_buf[1] = 0x0F;
-    data_buf[2] = 0x00; //gc
-    SPI_Write_Buffer(0x02, data_buf, 3);
+/*******************************************************************************
+* Function   :     	BLE_Trace_State
+* Parameter  :     	uint8_t id, TR_ID_EVT_START/TR_ID_GUARD
+* Returns    :     	void
+* Description:      trace id with ble_state
+* Note:      :      empty if !TRACE_ON
+*******************************************************************************/
+static void BLE_Trace_State(uint8_t id)
+{
+#if TRACE_ON
+    uint8_t state = ble_state;
 
-    data_buf[0] = 0x80;
-    data_buf[1] = 0x70; //gain
-    data_buf[2] = 0x21;
-    data_buf[3] = 0x40; //rx
-    SPI_Write_Buffer(0x0b, data_buf, 4);
+    TRACE(id, &state, 1);
+#endif
+}
 
-    SPI_Write_Reg(0x29, 0x71); //gain
+/*******************************************************************************
+* Function   :     	BLE_Trace_Hit
+* Parameter  :     	const BLE_PduTypeDef *pdu
+* Returns    :     	void
+* Description:      trace a wanted PDU: offset in the rx window, rssi, type
+* Note:      :      empty if !TRACE_ON
+*******************************************************************************/
+static void BLE_Trace_Hit(const BLE_PduTypeDef *pdu)
+{
+#if TRACE_ON
+    uint8_t arg[6];
+    uint32_t offset = pdu->time - ble_rx_wake;
+
+    arg[0] = (uint8_t)offset;
+    arg[1] = (uint8_t)(offset >> 8);
+    arg[2] = (uint8_t)(offset >> 16);
+    arg[3] = (uint8_t)(offset >> 24);
+    arg[4] = pdu->rssi;
+    arg[5] = pdu->hdr[0] & 0x0F;
+    TRACE(TR_ID_RX_HIT, arg, 6);
+#endif
+}
 
-    data_buf[0] = 0x10;
-    data_buf[1] = 0x02;
-    SPI_Write_Buffer(0xA, data_buf, 2);
+/*******************************************************************************
+* Function   :     	BLE_Trace_End
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      trace the end of an adv event: wanted PDUs, sleep or idle
+* Note:      :      empty if !TRACE_ON
+*******************************************************************************/
+static void BLE_Trace_End(void)
+{
+#if TRACE_ON
+    uint8_t arg[2];
 
-    data_buf[0] = 0x02;
-    data_buf[1] = 0x12;
-    SPI_Write_Buffer(0xD, data_buf, 2);
+    arg[0] = ble_rxgot;
+    arg[1] = (ble_interval && (txcnt + rxcnt));
+    TRACE(TR_ID_EVT_END, arg, 2);
+#endif
+}
 
-    data_buf[0] = 0x01;
-    data_buf[1] = 0x07;
-    SPI_Write_Buffer(0xE, data_buf, 2);
+/*******************************************************************************
+* Function   :     	BLE_Guard_Expire
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      guard time ran out, let GPIOB_IRQHandler recover
+* Note:      :      TK_ID_GUARD expiry, from LPTIMER_IRQHandler
+*******************************************************************************/
+static void BLE_Guard_Expire(void)
+{
+    NVIC_SetPendingIRQ(GPIOB_IRQn);
+}
 
-    SPI_Write_Reg(0x50, 0x56);
-    SPI_Write_Reg(0x20,0x1);
+/*******************************************************************************
+* Function   :     	BLE_Guard_Set
+* Parameter  :     	uint32_t ms, 0: off
+* Returns    :     	void
+* Description:      (re)arm the guard for the BLE interrupt now awaited
+* Note:      :
+*******************************************************************************/
+static void BLE_Guard_Set(uint32_t ms)
+{
+    if(ms){
+        TK_Start(TK_ID_GUARD, ms, BLE_Guard_Expire);
+    }else{
+        TK_Stop(TK_ID_GUARD);
+    }
 }
 
 /*******************************************************************************
-* Function   :     	BLE_TRX
+* Function   :     	BLE_Start
 * Parameter  :     	txcnt, rxcnt
 * Returns    :     	void
-* Description:      Beacon data .process .
-* Note:      :
+* Description:      start one adv event: txcnt tx + rxcnt rx on channel 37.38.39
+* Note:      :      returns at once, the event runs in GPIOB_IRQHandler.
+*                   BLE_Mode_PwrUp only if the BLE was powered down
 *******************************************************************************/
-void BLE_TRX()
+void BLE_Start(void)
 {
-    uint8_t status = 0;
-    uint8_t ch = 37;
-    uint8_t data_buf[2];
-    uint8_t tmp_cnt = txcnt+rxcnt;
-    uint8_t len_pdu = 0;
-    uint8_t loop = 0;
-    uint8_t rssi = 0;
+    uint32_t now;
+    uint8_t warm;
+#if TRACE_ON
+    uint32_t t0 = TB_Get_Us();
+#endif
 
-    if(tmp_cnt == 0) return;
+    if(ble_state != BLE_STATE_IDLE) return;
+    if((txcnt+rxcnt) == 0) return;
 
+    SysClock_Burst_Enter();
 
-    BLE_Mode_PwrUp();
+    ble_txcnt = txcnt;
+    ble_rxcnt = rxcnt;
+    ble_ch = 37;
 
-#if 1  //if adv_data no change, can move this block to the end of BLE_Init()
-    //set BLE TX default channel:37.38.39
-    SPI_Write_Reg(CH_NO|0X20, ch);
+    now = TK_Get_Ms();
+    ble_start_gap = ble_started ? (now - ble_start_ms) : 0;    //not from boot
+    ble_start_ms = now;
+    ble_started = 1;
 
-    //BLT FIFO write adv_data . max len:31 byte
-    SPI_Write_Buffer(W_TX_PAYLOAD, adv_data, LEN_DATA);
+    //retained: the BLE sleeps with registers and calibration kept
+    NVIC_DisableIRQ(GPIOB_IRQn);
+    warm = ble_retained && BLE_IRQ_GET() && !BLE_Cal_Needed();
+    if(ble_retained && !warm){
+        BLE_Mode_PwrDn();   //TB and pins as after a power down
+    }
+    ble_retained = 0;
+    NVIC_EnableIRQ(GPIOB_IRQn);
+
+    if(warm){
+        ble_wake_warm++;
+        ble_cal_skip++;
+    }else{
+        BLE_Mode_PwrUp();
+        ble_wake_cold++;
+    }
 
-    //PDU TYPE: 2  non-connectable undirected advertising . tx add:random address
-    //set BLT PDU length:adv_data+6 mac adress.
-    data_buf[0] = 0x02;
-    data_buf[1] = LEN_DATA+LEN_BLE_ADDR;
-    SPI_Write_Buffer(ADV_HDR_TX, data_buf, 2);
+    //set BLE TX default channel:37.38.39
+    BLE_Set_Channel(ble_ch);
 
-    //clear all interrupt
-    data_buf[0] = 0xFF;
-    data_buf[1] = 0x80;
-    SPI_Write_Buffer(INT_FLAG, data_buf, 2);
-#endif
+    BLE_Stage_Commit();
+
+    //no SPI until BLE_Set_TimeOut, BLE_STAGE_ASYNC: while the writes run
+    ble_rxgot = 0;
+    BLE_Trace_State(TR_ID_EVT_START);
+    BLE_Guard_Set(BLE_GUARD_TIME);
 
     BLE_Set_TimeOut(BLE_RX_TIMEOUT);
-    
+
+    ble_evt_start = TB_Get_Us();
+    ble_state = BLE_STATE_WAKEUP;
     BLE_Mode_Wakeup();
-    tick = BLE_GUARD_TIME;
+    TRACE_U32(TR_ID_WAKE, TB_Get_Us() - t0, warm);
+
+    SysClock_Burst_Exit();
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Set_Interval
+* Parameter  :     	uint16_t interval_ms, 0: stop
+* Returns    :     	void
+* Description:      repeat the adv event every interval_ms, timed by the BLE
+* Note:      :      BLE_Start() runs the first one. 0 idles the BLE (see
+*                   BLE_Power_Idle) if it sleeps between events, else after
+*                   the running one
+*******************************************************************************/
+void BLE_Set_Interval(uint16_t interval_ms)
+{
+    ble_interval = interval_ms;
+
+    if((interval_ms == 0) && (ble_state == BLE_STATE_SLEEP)){
+        NVIC_DisableIRQ(GPIOB_IRQn);
+        if(ble_state == BLE_STATE_SLEEP){
+            BLE_Power_Idle();
+        }
+        NVIC_EnableIRQ(GPIOB_IRQn);
+    }
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Set_NextStart
+* Parameter  :     	uint32_t ms, 0: unknown
+* Returns    :     	void
+* Description:      expected time from a BLE_Start() to the next one
+* Note:      :      0: the last measured gap is used, see BLE_RETAIN_MS
+*******************************************************************************/
+void BLE_Set_NextStart(uint32_t ms)
+{
+    ble_next_ms = ms;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Set_Retain
+* Parameter  :     	uint32_t ms, 0: always power down
+* Returns    :     	void
+* Description:      light sleep between BLE_Start() calls up to this gap
+* Note:      :      takes effect at the end of the next adv events, see BLE_RETAIN_MS
+*******************************************************************************/
+void BLE_Set_Retain(uint32_t ms)
+{
+    ble_retain_ms = ms;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Get_WakeCount
+* Parameter  :     	uint32_t *cold, uint32_t *warm
+* Returns    :     	void
+* Description:      BLE_Start() with full power up, with light sleep resume
+* Note:      :
+*******************************************************************************/
+void BLE_Get_WakeCount(uint32_t *cold, uint32_t *warm)
+{
+    *cold = ble_wake_cold;
+    *warm = ble_wake_warm;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Power_Idle
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      end of the adv events: light sleep or power down
+* Note:      :      GPIOB_IRQHandler or GPIOB_IRQn masked
+*******************************************************************************/
+static void BLE_Power_Idle(void)
+{
+    uint32_t gap = ble_next_ms ? ble_next_ms : ble_start_gap;
+    uint8_t retain = (gap && (gap <= ble_retain_ms));
+
+    TRACE_U32(TR_ID_IDLE, gap, retain);
+    if(retain){
+        BLE_Mode_Sleep();   //no timed wakeup
+        ble_retained = 1;
+    }else{
+        BLE_Mode_PwrDn();
+        ble_retained = 0;
+    }
+    BLE_Guard_Set(0);
+    ble_state = BLE_STATE_IDLE;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Retain_Expire
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      retained BLE woke itself, BLE_WAKE_NEVER ran out
+* Note:      :      idle far longer than ble_retain_ms, power down
+*******************************************************************************/
+static void BLE_Retain_Expire(void)
+{
+    uint8_t status;
+
+    SPI_Select_Bank(BANK_56);
+    status = SPI_Read_Reg(INT_FLAG);
+    SPI_Write_Reg(INT_FLAG|0X20, status);
+
+    BLE_Mode_PwrDn();
+    ble_retained = 0;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_Next_Event
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      set up the next adv event and let the BLE sleep until then
+* Note:      :      interval counts from the start of this adv event
+*******************************************************************************/
+static void BLE_Next_Event(void)
+{
+    uint32_t elapsed;
+
+    ble_txcnt = txcnt;
+    ble_rxcnt = rxcnt;
+    ble_rxgot = 0;
+    ble_ch = 37;
+    BLE_Set_Channel(ble_ch);
+    BLE_Stage_Commit();
+    BLE_Guard_Set(ble_interval + BLE_GUARD_TIME);   //no SPI, see BLE_Start
+
+    elapsed = TB_Get_Us() - ble_evt_start;
+    if(elapsed >= (ble_interval * 1000UL)){
+        elapsed = ble_interval * 1000UL - 1000;  //late, wake at once
+    }
+    BLE_Mode_SleepWake((ble_interval * 1000UL - elapsed) * LFCLK_1MS / 1000);
+
+    ble_state = BLE_STATE_SLEEP;
+}
+
+/*******************************************************************************
+* Function   :     	BLE_TRX
+* Parameter  :     	txcnt, rxcnt
+* Returns    :     	void
+* Description:      Beacon data .process .
+* Note:      :      MCU sleeps between BLE interrupts until the event is done
+*******************************************************************************/
+void BLE_TRX(void)
+{
+    BLE_Start();
 
-    while(1)
+    while(!ble_McuCanSleep())
     {
-        //BLE IRQ LOW
-        if (!BLE_IRQ_GET())
-        {
-            //clear interrupt flag
-            status = SPI_Read_Reg(INT_FLAG);
-            SPI_Write_Reg(INT_FLAG|0X20, status);
-            //Uart_Send_Byte(status); //debug
-
-            if(INT_TYPE_WAKEUP & status)//wakeup
-            {
-                if(txcnt > 0){
-                    txcnt --;
-                    SPI_Write_Reg(MODE_TYPE|0X20, RADIO_MODE_ADV_TX);
-                    BLE_Set_StartTime(BLE_START_TIME);
-                }else if(rxcnt > 0){
-                    rxcnt --;
-                    SPI_Write_Reg(MODE_TYPE|0X20, RADIO_MODE_ADV_RX);
-                    BLE_Set_StartTime(BLE_START_TIME);
-                }
-                continue; //goto while(1)
+        __disable_irq();
+        if(!ble_McuCanSleep()){
+            SCB->SCR &= (~0x04);
+            __WFI();
+        }
+        __enable_irq();
+    }
+}
 
-            }
+/*******************************************************************************
+* Function   :     	ble_McuCanSleep
+* Parameter  :     	void
+* Returns    :     	uint8_t, 1: no adv event running
+* Description:
+* Note:      :      BLE_STATE_SLEEP: the BLE IRQ wakes the MCU
+*******************************************************************************/
+uint8_t ble_McuCanSleep(void)
+{
+    return ((ble_state == BLE_STATE_IDLE) || (ble_state == BLE_STATE_SLEEP));
+}
 
-            BLE_Mode_Sleep();
+/*******************************************************************************
+* Function   :     	BLE_Event
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      adv event state machine, one BLE interrupt
+* Note:      :
+*******************************************************************************/
+static void BLE_Event(void)
+{
+    uint8_t status;
+    uint32_t start;
+    uint32_t timeout;
+    BLE_PduTypeDef *pdu;
 
-            if(INT_TYPE_PDU_OK & status){ //only happen in rx application, no need porting in tx only application
-                rssi = BLE_Get_RSSI();
-                BLE_Get_Pdu(rx_buf, &len_pdu);
-#if 1 //debug
-                Uart_Send_String("\r\nRX[");
-                Uart_Send_Byte(rssi);
-                Uart_Send_String("]: ");
-                for(loop=0; loop<len_pdu; loop++){
-                    Uart_Send_Byte(rx_buf[loop]);
-                    Uart_Send_String(" ");
-                }
-#endif
-                LED_RED_ON(); //debug
-            }else if(INT_TYPE_TX_START & status){ //only happen in tx application
-                LED_GREEN_ON(); //debug
-            }
+    //clear interrupt flag
+    SPI_Select_Bank(BANK_56);
+    status = SPI_Read_Reg(INT_FLAG);
+    SPI_Write_Reg(INT_FLAG|0X20, status);
 
-            if(INT_TYPE_SLEEP & status)//sleep
-            {
-                LED_GREEN_OFF(); //debug
-                LED_RED_OFF();  //debug
-                tick = BLE_GUARD_TIME;
+    if(INT_TYPE_WAKEUP & status)//wakeup
+    {
+        if(ble_state == BLE_STATE_SLEEP){ //BLE timed, next adv event
+            ble_evt_start = TB_Get_Us();
+            BLE_Trace_State(TR_ID_EVT_START);
+            BLE_Guard_Set(BLE_GUARD_TIME);
+            ble_state = BLE_STATE_WAKEUP;
+        }
+        if(ble_state != BLE_STATE_WAKEUP) return;
+
+        if(ble_txcnt > 0){
+            ble_txcnt --;
+            SPI_Write_Reg(MODE_TYPE|0X20, RADIO_MODE_ADV_TX);
+            BLE_Set_StartTime(BLE_START_TIME);
+        }else if(ble_rxcnt > 0){
+            ble_rxcnt --;
+            ble_rx_wake = TB_Get_Us();
+            ble_rx_on = 1;
+            RxW_Next(&start, &timeout);
+            TRACE_U32(TR_ID_RX_WIN, start, timeout);
+            SPI_Select_Bank(BANK_56);
+            SPI_Write_Reg(MODE_TYPE|0X20, RADIO_MODE_ADV_RX);
+            BLE_Set_TimeOut(timeout);
+            BLE_Set_StartTime(start * (HFCLK_1MS/1000));
+        }
+        ble_state = BLE_STATE_TRX;
+        return;
+    }
 
-                //BLE channel
-                if (++ch > 39){
-                    ch = 37;
-                }
-                SPI_Write_Reg(CH_NO|0X20, ch);
+    BLE_Mode_Sleep();
 
-                tmp_cnt --;
-                if(tmp_cnt == 0){
-                    BLE_Mode_PwrDn();
-                    break; //exit from while(1)
+    if(INT_TYPE_PDU_OK & status){ //only happen in rx application, no need porting in tx only application
+        //ring full: filtered all the same, only a wanted PDU is a drop
+        pdu = RxQ_Alloc();
+        if(pdu == 0) pdu = &ble_pdu_full;
+        //unwanted advA: payload is not clocked out
+        if(BLE_Read_Pdu_Head(pdu) && RxF_Accept_Addr(pdu)){
+            pdu->time = TB_Get_Us();    //still BANK_56, before the rssi read
+            BLE_Read_Pdu_Data(pdu);
+            if(RxF_Accept_Data(pdu)){
+                RxW_Hit(pdu->time - ble_rx_wake);
+                if(pdu == &ble_pdu_full){
+                    if(!RxF_Is_Seen(pdu)) RxQ_Drop();   //not remembered, its next copy gets in
+                }else if(!RxF_Is_Dup(pdu)){
+                    RxQ_Commit();
+                    ble_rxgot++;
+                    BLE_Trace_Hit(pdu);
                 }
-                else
-                    BLE_Mode_Wakeup();
             }
+        }
+        LED_RED_ON(); //debug
+    }else if(INT_TYPE_TX_START & status){ //only happen in tx application
+        LED_GREEN_ON(); //debug
+    }
 
+    if(INT_TYPE_SLEEP & status)//sleep
+    {
+        LED_GREEN_OFF(); //debug
+        LED_RED_OFF();  //debug
+
+        if(ble_rx_on){
+            ble_rx_on = 0;
+            RxW_End();
+            //enough wanted PDUs, close the remaining rx windows
+            if(RxW_Get_Expect() && (ble_rxgot >= RxW_Get_Expect())){
+                ble_rxcnt = 0;
+            }
         }
-        else if(tick == 0){ //robustness, in case no int
-            BLE_Mode_Sleep();
+
+        //BLE channel
+        if (++ble_ch > 39){
+            ble_ch = 37;
         }
+        BLE_Set_Channel(ble_ch);
 
+        if((ble_txcnt + ble_rxcnt) == 0){
+            BLE_Trace_End();
+            if(ble_interval && (txcnt + rxcnt)){
+                BLE_Next_Event();
+                return;
+            }
+            BLE_Power_Idle();
+        }else{
+            BLE_Guard_Set(BLE_GUARD_TIME);
+            ble_state = BLE_STATE_WAKEUP;
+            BLE_Mode_Wakeup();
+        }
+    }
+}
+
+/*******************************************************************************
+* Function   :     	GPIOB_IRQHandler
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      BLE IRQ(PB4, low active) and guard timeout
+* Note:      :
+*******************************************************************************/
+void GPIOB_IRQHandler(void)
+{
+    if((GPIOB->RIS & GPIO_Pin_4) && (GPIOB->MIS & GPIO_Pin_4)) {
+        GPIOB->ICLR |= GPIO_Pin_4;
     }
+
+    if(ble_state == BLE_STATE_IDLE){
+        if(ble_retained && !BLE_IRQ_GET()) BLE_Retain_Expire();
+        return;
+    }
+
+    SysClock_Burst_Enter();
+
+    if(!BLE_IRQ_GET()){
+        //IRQ stays low while a flag is set, no new edge for it
+        do{
+            BLE_Event();
+        }while(!BLE_IRQ_GET() && (ble_state != BLE_STATE_IDLE));
+    }else if(!TK_Running(TK_ID_GUARD)){ //robustness, in case no int
+        BLE_Trace_State(TR_ID_GUARD);
+        if(ble_state == BLE_STATE_SLEEP){ //missed self wakeup
+            ble_evt_start = TB_Get_Us();
+            BLE_Guard_Set(BLE_GUARD_TIME);
+            ble_state = BLE_STATE_WAKEUP;
+            BLE_Mode_Wakeup();
+        }else{
+            ble_stage |= BLE_STAGE_INT; //flags may be left set
+            BLE_Mode_Sleep();
+            BLE_Guard_Set(BLE_GUARD_TIME);
+        }
+    }
+
+    SysClock_Burst_Exit();
 }
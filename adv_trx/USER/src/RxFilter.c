@@ -0,0 +1,326 @@
+/**
+  ******************************************************************************
+  * @file    :RxFilter.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :received PDU filters, run in GPIOB_IRQHandler before RxQ_Commit
+  *           accept list on advA/payload, duplicate filter
+  ******************************************************************************
+***/
+
+/* Includes ------------------------------------------------------------------*/
+#include "Includes.h"
+
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+    uint8_t len;
+    uint8_t prefix[LEN_BLE_ADDR];   //MSB first, as printed
+}RxF_AddrTypeDef;
+
+typedef struct
+{
+    uint16_t addr_fp;   //advA hash, upper 16 bits. 0: free
+    uint16_t data_fp;   //pdu type, length, payload hash
+    uint16_t time;      //first report, RXF_TIME_SHIFT units
+}RxF_DupTypeDef;
+
+/* Private define ------------------------------------------------------------*/
+#define RXF_TIME_SHIFT      16  //entry time: TB_Get_Us() >> 16, 65.536ms units
+
+/* Private variables ---------------------------------------------------------*/
+static RxF_AddrTypeDef rxf_addr[RXF_ADDR_MAX];
+static uint8_t rxf_addr_cnt = 0;
+static uint16_t rxf_id[RXF_ID_MAX];     //company ID or 16-bit UUID
+static uint8_t rxf_id_type[RXF_ID_MAX]; //BLE_GAP_AD_TYPE_ of rxf_id
+static uint8_t rxf_id_cnt = 0;
+
+static RxF_DupTypeDef rxf_dup[RXF_DUP_SETS][RXF_DUP_WAYS];
+static uint16_t rxf_dup_window = (RXF_DUP_WINDOW*125UL) >> 13;  //RXF_TIME_SHIFT units
+static uint16_t rxf_dup_cnt = 0;
+
+
+/*******************************************************************************
+* Function   :     	RxF_Hash
+* Parameter  :     	uint32_t hash, const uint8_t *data, uint8_t len
+* Returns    :     	uint32_t
+* Description:      FNV-1a, continue from hash
+* Note:      :      start with 2166136261
+*******************************************************************************/
+static uint32_t RxF_Hash(uint32_t hash, const uint8_t *data, uint8_t len)
+{
+    while(len--){
+        hash ^= *data++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Clear_List
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      empty the accept list, all PDUs pass
+* Note:      :
+*******************************************************************************/
+void RxF_Clear_List(void)
+{
+    rxf_addr_cnt = 0;
+    rxf_id_cnt = 0;
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Add_Addr
+* Parameter  :     	const uint8_t *prefix, MSB first. uint8_t len, 1..6
+* Returns    :     	uint8_t, 1: added, 0: list full
+* Description:      accept advA starting with prefix, e.g. an OUI
+* Note:      :
+*******************************************************************************/
+uint8_t RxF_Add_Addr(const uint8_t *prefix, uint8_t len)
+{
+    if((rxf_addr_cnt >= RXF_ADDR_MAX) || (len == 0) || (len > LEN_BLE_ADDR)) return 0;
+
+    rxf_addr[rxf_addr_cnt].len = len;
+    memcpy(rxf_addr[rxf_addr_cnt].prefix, prefix, len);
+    rxf_addr_cnt++;
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Add_Id
+* Parameter  :     	uint8_t type, uint16_t id
+* Returns    :     	uint8_t, 1: added, 0: list full
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t RxF_Add_Id(uint8_t type, uint16_t id)
+{
+    if(rxf_id_cnt >= RXF_ID_MAX) return 0;
+
+    rxf_id_type[rxf_id_cnt] = type;
+    rxf_id[rxf_id_cnt] = id;
+    rxf_id_cnt++;
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Add_Company
+* Parameter  :     	uint16_t id, e.g. 0x004C
+* Returns    :     	uint8_t, 1: added, 0: list full
+* Description:      accept manufacturer specific data of company id
+* Note:      :
+*******************************************************************************/
+uint8_t RxF_Add_Company(uint16_t id)
+{
+    return RxF_Add_Id(BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, id);
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Add_Uuid16
+* Parameter  :     	uint16_t uuid
+* Returns    :     	uint8_t, 1: added, 0: list full
+* Description:      accept 16-bit service UUID list or service data of uuid
+* Note:      :
+*******************************************************************************/
+uint8_t RxF_Add_Uuid16(uint16_t uuid)
+{
+    return RxF_Add_Id(BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_COMPLETE, uuid);
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Accept_Addr
+* Parameter  :     	const BLE_PduTypeDef *pdu, hdr and addr read
+* Returns    :     	uint8_t, 1: read the payload, 0: drop
+* Description:      advA against the address prefixes
+* Note:      :
+*******************************************************************************/
+uint8_t RxF_Accept_Addr(const BLE_PduTypeDef *pdu)
+{
+    uint8_t i;
+    uint8_t k;
+
+    if(rxf_addr_cnt == 0) return 1;
+
+    for(i=0; i<rxf_addr_cnt; i++){
+        for(k=0; k<rxf_addr[i].len; k++){
+            if(rxf_addr[i].prefix[k] != pdu->addr[LEN_BLE_ADDR-1-k]) break;
+        }
+        if(k == rxf_addr[i].len) return 1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Match_Id
+* Parameter  :     	uint8_t type, uint16_t id
+* Returns    :     	uint8_t, 1: on the list
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t RxF_Match_Id(uint8_t type, uint16_t id)
+{
+    uint8_t i;
+
+    for(i=0; i<rxf_id_cnt; i++){
+        if((rxf_id_type[i] == type) && (rxf_id[i] == id)) return 1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Accept_Data
+* Parameter  :     	const BLE_PduTypeDef *pdu, payload read
+* Returns    :     	uint8_t, 1: keep, 0: drop
+* Description:      AD structures against company IDs and service UUIDs
+* Note:      :      malformed AD data stops the scan
+*******************************************************************************/
+uint8_t RxF_Accept_Data(const BLE_PduTypeDef *pdu)
+{
+    const uint8_t *ad;
+    uint8_t pos;
+    uint8_t ad_len;
+    uint8_t k;
+
+    if(rxf_id_cnt == 0) return 1;
+
+    for(pos=0; (pos+1) < pdu->len; pos+=ad_len+1){
+        ad_len = pdu->data[pos];
+        if((ad_len == 0) || ((pos+1+ad_len) > pdu->len)) break;
+        ad = &pdu->data[pos+1]; //ad[0]: type, ad[1..ad_len-1]: data
+
+        switch(ad[0]){
+            case BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA:
+                if((ad_len >= 3) &&
+                   RxF_Match_Id(BLE_GAP_AD_TYPE_MANUFACTURER_SPECIFIC_DATA, ad[1] | (ad[2] << 8))) return 1;
+                break;
+            case BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_MORE_AVAILABLE:
+            case BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_COMPLETE:
+                for(k=1; (k+1) < ad_len; k+=2){
+                    if(RxF_Match_Id(BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_COMPLETE, ad[k] | (ad[k+1] << 8))) return 1;
+                }
+                break;
+            case BLE_GAP_AD_TYPE_SERVICE_DATA:
+                if((ad_len >= 3) &&
+                   RxF_Match_Id(BLE_GAP_AD_TYPE_16BIT_SERVICE_UUID_COMPLETE, ad[1] | (ad[2] << 8))) return 1;
+                break;
+            default:
+                break;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Set_DupWindow
+* Parameter  :     	uint32_t window_ms, 0: filter off
+* Returns    :     	void
+* Description:      an advertiser is reported again once window_ms has passed
+* Note:      :      max 4294967ms, in 65.536ms steps rounded down: a copy is
+*                   never dropped after window_ms, may be reported up to
+*                   131ms early. below 66ms: filter off
+*******************************************************************************/
+void RxF_Set_DupWindow(uint32_t window_ms)
+{
+    uint32_t window = (window_ms * 125UL) >> 13;   //ms*1000/65536, rounded down
+
+    rxf_dup_window = (window > 0xFFFF) ? 0xFFFF : (uint16_t)window;
+    memset(rxf_dup, 0, sizeof(rxf_dup));
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Dup_Find
+* Parameter  :     	const BLE_PduTypeDef *pdu, pdu->time set. uint8_t keep
+* Returns    :     	uint8_t, 1: already reported in the window
+* Description:      look up advA + payload, remember it if new and keep
+* Note:      :      full set: the oldest entry is replaced
+*******************************************************************************/
+static uint8_t RxF_Dup_Find(const BLE_PduTypeDef *pdu, uint8_t keep)
+{
+    RxF_DupTypeDef *set;
+    RxF_DupTypeDef *old;
+    uint32_t hash;
+    uint32_t mix;
+    uint16_t addr_fp;
+    uint16_t data_fp;
+    uint16_t now;
+    uint8_t way;
+
+    if(rxf_dup_window == 0) return 0;
+
+    hash = RxF_Hash(2166136261UL, pdu->addr, LEN_BLE_ADDR);
+
+    //FNV low bits mix poorly, finalize before picking set and fingerprint
+    mix = hash ^ (hash >> 15);
+    mix *= 0x2c1b3c6dUL;
+    mix ^= mix >> 12;
+    set = rxf_dup[mix & (RXF_DUP_SETS-1)];
+    addr_fp = (uint16_t)(mix >> 16);
+    if(addr_fp == 0) addr_fp = 1;
+
+    hash = RxF_Hash(hash, pdu->hdr, 2);
+    data_fp = (uint16_t)RxF_Hash(hash, pdu->data, pdu->len);
+    now = (uint16_t)(pdu->time >> RXF_TIME_SHIFT);
+
+    old = 0;
+    for(way=0; way<RXF_DUP_WAYS; way++){
+        if(set[way].addr_fp == addr_fp){
+            if((set[way].data_fp == data_fp) && ((uint16_t)(now - set[way].time) < rxf_dup_window)){
+                if(rxf_dup_cnt < 0xFFFF) rxf_dup_cnt++;
+                return 1;
+            }
+            old = &set[way]; //same advA, new data or expired: reuse its entry
+            break;
+        }
+        //victim: a free entry, else the oldest
+        if((old == 0) || ((old->addr_fp != 0) &&
+           ((set[way].addr_fp == 0) || ((int16_t)(set[way].time - old->time) < 0)))){
+            old = &set[way];
+        }
+    }
+
+    if(keep){
+        old->addr_fp = addr_fp;
+        old->data_fp = data_fp;
+        old->time = now;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Is_Dup
+* Parameter  :     	const BLE_PduTypeDef *pdu, pdu->time set
+* Returns    :     	uint8_t, 1: already reported in the window, drop it
+* Description:      look up advA + payload, remember it if new
+* Note:      :
+*******************************************************************************/
+uint8_t RxF_Is_Dup(const BLE_PduTypeDef *pdu)
+{
+    return RxF_Dup_Find(pdu, 1);
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Is_Seen
+* Parameter  :     	const BLE_PduTypeDef *pdu, pdu->time set
+* Returns    :     	uint8_t, 1: already reported in the window
+* Description:      look up only, for a PDU that is not reported (ring full):
+*                   its next copy must still get in
+* Note:      :
+*******************************************************************************/
+uint8_t RxF_Is_Seen(const BLE_PduTypeDef *pdu)
+{
+    return RxF_Dup_Find(pdu, 0);
+}
+
+/*******************************************************************************
+* Function   :     	RxF_Get_DupCount
+* Parameter  :     	void
+* Returns    :     	uint16_t
+* Description:      PDUs dropped as duplicate since reset, saturates at 0xFFFF
+* Note:      :
+*******************************************************************************/
+uint16_t RxF_Get_DupCount(void)
+{
+    return rxf_dup_cnt;
+}
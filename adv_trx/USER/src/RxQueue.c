@@ -0,0 +1,115 @@
+/**
+  ******************************************************************************
+  * @file    :RxQueue.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :received PDU ring, GPIOB_IRQHandler -> main loop
+  ******************************************************************************
+***/
+
+/* Includes ------------------------------------------------------------------*/
+#include "Includes.h"
+
+
+/* Private define ------------------------------------------------------------*/
+#define RXQ_MASK        (RXQ_SIZE-1)
+
+/* Private variables ---------------------------------------------------------*/
+static BLE_PduTypeDef rxq_buf[RXQ_SIZE];
+static volatile uint8_t rxq_head = 0;   //written by producer only
+static volatile uint8_t rxq_tail = 0;   //written by consumer only
+static volatile uint16_t rxq_drop = 0;  //PDUs lost to a full ring
+
+
+/*******************************************************************************
+* Function   :     	RxQ_Alloc
+* Parameter  :     	void
+* Returns    :     	BLE_PduTypeDef *, 0: ring full
+* Description:      producer, next free record. published by RxQ_Commit
+* Note:      :      a full ring is not a drop yet, see RxQ_Drop
+*******************************************************************************/
+BLE_PduTypeDef *RxQ_Alloc(void)
+{
+    uint8_t head = rxq_head;
+
+    if((uint8_t)(head - rxq_tail) >= RXQ_SIZE) return 0;
+    return &rxq_buf[head & RXQ_MASK];
+}
+
+/*******************************************************************************
+* Function   :     	RxQ_Drop
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      producer, a PDU that passed the filters found the ring full
+* Note:      :
+*******************************************************************************/
+void RxQ_Drop(void)
+{
+    if(rxq_drop < 0xFFFF) rxq_drop++;
+}
+
+/*******************************************************************************
+* Function   :     	RxQ_Commit
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      producer, publish the record from RxQ_Alloc
+* Note:      :
+*******************************************************************************/
+void RxQ_Commit(void)
+{
+    __DMB(); //record written before it is visible
+    rxq_head++;
+}
+
+/*******************************************************************************
+* Function   :     	RxQ_Count
+* Parameter  :     	void
+* Returns    :     	uint8_t
+* Description:      consumer, records ready
+* Note:      :
+*******************************************************************************/
+uint8_t RxQ_Count(void)
+{
+    return (uint8_t)(rxq_head - rxq_tail);
+}
+
+/*******************************************************************************
+* Function   :     	RxQ_Front
+* Parameter  :     	void
+* Returns    :     	BLE_PduTypeDef *, 0: ring empty
+* Description:      consumer, oldest record. valid until RxQ_Pop
+* Note:      :
+*******************************************************************************/
+BLE_PduTypeDef *RxQ_Front(void)
+{
+    uint8_t tail = rxq_tail;
+
+    if(rxq_head == tail) return 0;
+    return &rxq_buf[tail & RXQ_MASK];
+}
+
+/*******************************************************************************
+* Function   :     	RxQ_Pop
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      consumer, release the record from RxQ_Front
+* Note:      :
+*******************************************************************************/
+void RxQ_Pop(void)
+{
+    __DMB(); //record read before its slot is reused
+    rxq_tail++;
+}
+
+/*******************************************************************************
+* Function   :     	RxQ_Get_Drop
+* Parameter  :     	void
+* Returns    :     	uint16_t
+* Description:      wanted PDUs lost to a full ring since reset, saturates at 0xFFFF
+* Note:      :
+*******************************************************************************/
+uint16_t RxQ_Get_Drop(void)
+{
+    return rxq_drop;
+}
@@ -0,0 +1,200 @@
+/**
+  ******************************************************************************
+  * @file    :RxWin.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :adaptive rx window, sizes START_TIME/TIMEOUT per rx
+  ******************************************************************************
+***/
+
+/* Includes ------------------------------------------------------------------*/
+#include "Includes.h"
+
+
+/* Private define ------------------------------------------------------------*/
+#define RXW_START_US        (BLE_START_TIME*1000UL/HFCLK_1MS)  //earliest start
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t rxw_lock = 0;        //arrival bounds below are valid
+static uint8_t rxw_miss = 0;        //windows in a row without PDU
+static uint8_t rxw_expect = 0;      //PDUs per adv event, 0: all rx windows
+static uint32_t rxw_min;            //arrival after wakeup, us
+static uint32_t rxw_max;
+static uint32_t rxw_start;          //window in use, us after wakeup
+static uint32_t rxw_timeout;
+static uint32_t rxw_offset;         //arrival in this window, 0: none
+static uint32_t rxw_prev;           //last arrival, 0: none
+static uint8_t rxw_since;           //windows since rxw_prev
+static int32_t rxw_drift;           //arrival change per wakeup, us
+static uint8_t rxw_drift_ok;        //rxw_drift measured at least once
+static uint32_t rxw_jitter;         //mean error of the drift prediction, us
+static RxW_StatTypeDef rxw_stat;
+
+
+/*******************************************************************************
+* Function   :     	RxW_Reset
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      forget the learned arrivals, full window next
+* Note:      :      e.g. after the accept list changed
+*******************************************************************************/
+void RxW_Reset(void)
+{
+    rxw_lock = 0;
+    rxw_miss = 0;
+    rxw_prev = 0;
+    rxw_drift = 0;
+    rxw_drift_ok = 0;
+    rxw_jitter = 0;
+}
+
+/*******************************************************************************
+* Function   :     	RxW_Shift
+* Parameter  :     	uint32_t bound, arrival after wakeup
+* Returns    :     	uint32_t, bound moved by the drift of one wakeup
+* Description:
+* Note:      :      stays >= 1, below RXW_START_US it is out of reach anyway
+*******************************************************************************/
+static uint32_t RxW_Shift(uint32_t bound)
+{
+    if((rxw_drift < 0) && ((uint32_t)(-rxw_drift) >= bound)) return 1;
+    return bound + rxw_drift;
+}
+
+/*******************************************************************************
+* Function   :     	RxW_Next
+* Parameter  :     	uint32_t *start_us, uint32_t *timeout_us
+* Returns    :     	void
+* Description:      window for the rx that starts now
+* Note:      :      start_us: BLE_Set_StartTime, timeout_us: BLE_Set_TimeOut
+*******************************************************************************/
+void RxW_Next(uint32_t *start_us, uint32_t *timeout_us)
+{
+    uint32_t start = RXW_START_US;
+    uint32_t end = RXW_START_US + BLE_RX_TIMEOUT;
+    uint32_t widen;
+
+    if(rxw_lock){
+        //offsets are against our own wakeup: the advertiser's clock and its
+        //advDelay move them every event, follow the learned drift
+        rxw_min = RxW_Shift(rxw_min);
+        rxw_max = RxW_Shift(rxw_max);
+        widen = (RXW_MARGIN_US + 2*rxw_jitter) << rxw_miss;
+
+        if(rxw_min > (RXW_START_US + widen)) start = rxw_min - widen;
+        if((rxw_max + widen) < end) end = rxw_max + widen;
+        //drifted past the end: keep the window within reach of the guard
+        if(start > (end - RXW_MIN_US)) start = end - RXW_MIN_US;
+        if((end - start) < RXW_MIN_US) end = start + RXW_MIN_US;
+    }
+
+    rxw_start = start;
+    rxw_timeout = end - start;
+    rxw_offset = 0;
+    rxw_stat.windows++;
+
+    *start_us = rxw_start;
+    *timeout_us = rxw_timeout;
+}
+
+/*******************************************************************************
+* Function   :     	RxW_Hit
+* Parameter  :     	uint32_t offset_us, PDU arrival after wakeup
+* Returns    :     	void
+* Description:      learn from a wanted PDU
+* Note:      :      bounds jump out to a new extreme, relax in by 1/8 per hit
+*                   the first PDU of a window also updates the drift
+*******************************************************************************/
+void RxW_Hit(uint32_t offset_us)
+{
+    int32_t drift;
+    int32_t err;
+
+    if(offset_us == 0) offset_us = 1;
+    if(rxw_offset == 0){
+        rxw_offset = offset_us;
+        //drift per wakeup since the last arrival, filtered. after a long gap
+        //it may have wrapped around our interval, no measure
+        if(rxw_prev && (rxw_since <= 2*RXW_MISS_MAX)){
+            drift = (int32_t)(offset_us - rxw_prev) / rxw_since;
+            if(rxw_drift_ok){
+                //advDelay: arrivals scatter around the drift, widen by that
+                err = (drift - rxw_drift) * rxw_since;
+                if(err < 0) err = -err;
+                if((uint32_t)err > rxw_jitter) rxw_jitter += ((uint32_t)err - rxw_jitter) >> RXW_DECAY;
+                else rxw_jitter -= (rxw_jitter - (uint32_t)err) >> RXW_DECAY;
+                rxw_drift += (drift - rxw_drift) / (1 << RXW_DRIFT_DECAY);
+            }else{
+                rxw_drift = drift;
+            }
+            rxw_drift_ok = 1;
+        }
+    }
+
+    if(!rxw_lock){
+        rxw_min = offset_us;
+        rxw_max = offset_us;
+        rxw_lock = 1;
+    }else{
+        if(offset_us < rxw_min) rxw_min = offset_us;
+        else rxw_min += (offset_us - rxw_min) >> RXW_DECAY;
+
+        if(offset_us > rxw_max) rxw_max = offset_us;
+        else rxw_max -= (rxw_max - offset_us) >> RXW_DECAY;
+    }
+    rxw_miss = 0;
+}
+
+/*******************************************************************************
+* Function   :     	RxW_End
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      window closed, by PDU or timeout
+* Note:      :      called on INT_TYPE_SLEEP of a rx
+*******************************************************************************/
+void RxW_End(void)
+{
+    if(rxw_offset){
+        rxw_prev = rxw_offset;
+        rxw_since = 0;
+        rxw_stat.hits++;
+        if(rxw_offset > rxw_start) rxw_stat.rx_us += rxw_offset - rxw_start;
+    }else{
+        rxw_stat.rx_us += rxw_timeout;
+        if(rxw_lock && (++rxw_miss > RXW_MISS_MAX)){
+            rxw_lock = 0;   //full window, the drift is kept
+            rxw_miss = 0;
+        }
+    }
+    if(rxw_since < 0xFF) rxw_since++;
+}
+
+/*******************************************************************************
+* Function   :     	RxW_Set_Expect
+* Parameter  :     	uint8_t cnt, 0: use all rxcnt windows
+* Returns    :     	void
+* Description:      end the adv event once cnt wanted PDUs are in
+* Note:      :
+*******************************************************************************/
+void RxW_Set_Expect(uint8_t cnt)
+{
+    rxw_expect = cnt;
+}
+
+uint8_t RxW_Get_Expect(void)
+{
+    return rxw_expect;
+}
+
+/*******************************************************************************
+* Function   :     	RxW_Get_Stat
+* Parameter  :     	void
+* Returns    :     	const RxW_StatTypeDef *
+* Description:      capture rate hits/windows against receiver time rx_us
+* Note:      :
+*******************************************************************************/
+const RxW_StatTypeDef *RxW_Get_Stat(void)
+{
+    return &rxw_stat;
+}
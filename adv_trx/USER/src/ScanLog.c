@@ -0,0 +1,388 @@
+/**
+  ******************************************************************************
+  * @file    :ScanLog.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :scan record ring in flash, see ScanLog.h
+  ******************************************************************************
+***/
+
+/* Includes ------------------------------------------------------------------*/
+#include "Includes.h"
+
+
+/* Private define ------------------------------------------------------------*/
+#define SL_MAGIC            0x4C53      //sector header low half, seq high half
+#define SL_TAG              0xB5        //batch header low byte
+#define SL_BLANK            0xFFFFFFFFUL
+#define SL_REC_SIZE         sizeof(SL_RecordTypeDef)
+#define SL_SECTOR_ADDR(s)   (SL_BASE + (uint32_t)(s)*FLASH_SECTOR_SIZE)
+
+#define SL_HDR(n, crc)      (SL_TAG | ((uint32_t)(n) << 8) | ((uint32_t)(crc) << 16))
+#define SL_HDR_TAG(hdr)     ((uint8_t)(hdr))
+#define SL_HDR_N(hdr)       ((uint8_t)((hdr) >> 8))
+#define SL_HDR_CRC(hdr)     ((uint16_t)((hdr) >> 16))
+
+/* Private variables ---------------------------------------------------------*/
+static SL_RecordTypeDef sl_buf[SL_BATCH];
+static uint8_t sl_count;                //records in sl_buf
+static uint16_t sl_drop;                //records lost, sl_buf full
+static uint8_t sl_active;               //sector written to
+static uint16_t sl_seq;                 //its header seq
+static uint32_t sl_free;                //next batch address in sl_active
+static uint32_t sl_mark_ms;             //TK_Get_Ms() of the last mark
+
+
+/*******************************************************************************
+* Function   :     	SL_Word
+* Parameter  :     	uint32_t addr
+* Returns    :     	uint32_t
+* Description:      read a flash word
+* Note:      :
+*******************************************************************************/
+static uint32_t SL_Word(uint32_t addr)
+{
+    return *(const volatile uint32_t *)addr;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Crc
+* Parameter  :     	const uint8_t *data, uint16_t len
+* Returns    :     	uint16_t
+* Description:      CRC-16 for batches and adv data hashes
+* Note:      :
+*******************************************************************************/
+static uint16_t SL_Crc(const uint8_t *data, uint16_t len)
+{
+    CRC_Ctx16TypeDef ctx;
+
+    CRC_StreamInit16(&ctx);
+    CRC_StreamUpdate16(&ctx, data, len);
+    return CRC_StreamFinal16(&ctx);
+}
+
+/*******************************************************************************
+* Function   :     	SL_Sector_Valid
+* Parameter  :     	uint8_t s
+* Returns    :     	uint8_t, 1: sector s carries a header
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t SL_Sector_Valid(uint8_t s)
+{
+    return ((SL_Word(SL_SECTOR_ADDR(s)) & 0xFFFF) == SL_MAGIC);
+}
+
+/*******************************************************************************
+* Function   :     	SL_Sector_Blank
+* Parameter  :     	uint8_t s
+* Returns    :     	uint8_t, 1: sector s is erased
+* Description:
+* Note:      :
+*******************************************************************************/
+static uint8_t SL_Sector_Blank(uint8_t s)
+{
+    uint32_t addr;
+
+    for(addr = SL_SECTOR_ADDR(s); addr < SL_SECTOR_ADDR(s+1); addr += 4){
+        if(SL_Word(addr) != SL_BLANK) return 0;
+    }
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Batch_End
+* Parameter  :     	uint32_t addr, uint32_t end
+* Returns    :     	uint32_t, address after the batch at addr, 0: none
+* Description:      walk one batch header of the sector ending at end
+* Note:      :      blank or broken header: no more batches
+*******************************************************************************/
+static uint32_t SL_Batch_End(uint32_t addr, uint32_t end)
+{
+    uint32_t hdr;
+    uint32_t next;
+
+    if(addr + 4 + SL_REC_SIZE > end) return 0;
+
+    hdr = SL_Word(addr);
+    next = addr + 4 + SL_HDR_N(hdr)*SL_REC_SIZE;
+    if((SL_HDR_TAG(hdr) != SL_TAG) || (SL_HDR_N(hdr) == 0) || (next > end)) return 0;
+    return next;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Sector_Open
+* Parameter  :     	uint8_t s, uint16_t seq
+* Returns    :     	void
+* Description:      erase sector s if needed and make it the active one
+* Note:      :      the oldest records go
+*******************************************************************************/
+static void SL_Sector_Open(uint8_t s, uint16_t seq)
+{
+    if(!SL_Sector_Blank(s)) FLASH_EraseSector(SL_SECTOR_ADDR(s));
+    FLASH_ProgramWord(SL_SECTOR_ADDR(s), SL_MAGIC | ((uint32_t)seq << 16));
+    sl_active = s;
+    sl_seq = seq;
+    sl_free = SL_SECTOR_ADDR(s) + 4;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Write
+* Parameter  :     	const SL_RecordTypeDef *rec, uint8_t n
+* Returns    :     	void
+* Description:      program one batch of n records at sl_free
+* Note:      :      caller checked the space
+*******************************************************************************/
+static void SL_Write(const SL_RecordTypeDef *rec, uint8_t n)
+{
+    uint16_t len = n*SL_REC_SIZE;
+
+    FLASH_ProgramWord(sl_free, SL_HDR(n, SL_Crc((const uint8_t *)rec, len)));
+    FLASH_ProgramBuffer(sl_free + 4, (const uint8_t *)rec, len, FLASH_BUFFER_WRITE);
+    sl_free += 4 + len;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Mark
+* Parameter  :     	uint8_t len, SL_LEN_BOOT or SL_LEN_CLOCK
+* Returns    :     	void
+* Description:      a mark record to sl_buf: TB_Get_Us() and TK_Get_Ms() now
+* Note:      :      caller checked the space
+*******************************************************************************/
+static void SL_Mark(uint8_t len)
+{
+    SL_RecordTypeDef *rec = &sl_buf[sl_count++];
+
+    sl_mark_ms = TK_Get_Ms();
+    memset(rec, 0, SL_REC_SIZE);
+    rec->us = TB_Get_Us();
+    rec->addr[0] = (uint8_t)sl_mark_ms;
+    rec->addr[1] = (uint8_t)(sl_mark_ms >> 8);
+    rec->addr[2] = (uint8_t)(sl_mark_ms >> 16);
+    rec->addr[3] = (uint8_t)(sl_mark_ms >> 24);
+    rec->type = SL_TYPE_MARK;
+    rec->len = len;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Init
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      find the newest sector and its end, write the boot mark
+* Note:      :      formats the area if no sector is valid. after TK_Init
+*******************************************************************************/
+void SL_Init(void)
+{
+    uint8_t s;
+    uint8_t found = 0;
+    uint16_t seq;
+    uint32_t end;
+    uint32_t next;
+
+    sl_count = 0;
+    for(s = 0; s < SL_SECTORS; s++)
+    {
+        if(!SL_Sector_Valid(s)) continue;
+        seq = (uint16_t)(SL_Word(SL_SECTOR_ADDR(s)) >> 16);
+        if(!found || ((int16_t)(seq - sl_seq) > 0)){
+            sl_active = s;
+            sl_seq = seq;
+            found = 1;
+        }
+    }
+
+    if(!found){
+        SL_Sector_Open(0, 1);
+    }else{
+        end = SL_SECTOR_ADDR(sl_active + 1);
+        sl_free = SL_SECTOR_ADDR(sl_active) + 4;
+        while((next = SL_Batch_End(sl_free, end)) != 0){
+            sl_free = next;
+        }
+        if((sl_free < end) && (SL_Word(sl_free) != SL_BLANK)){
+            sl_free = end;  //broken header, SL_Flush moves on
+        }
+    }
+
+    SL_Mark(SL_LEN_BOOT);
+    SL_Flush();
+}
+
+/*******************************************************************************
+* Function   :     	SL_Put
+* Parameter  :     	const BLE_PduTypeDef *pdu
+* Returns    :     	uint8_t, 1: logged, 0: sl_buf full, dropped
+* Description:      log one received PDU in RAM, returns at once
+* Note:      :      main loop. flash is written by SL_Poll. a clock mark goes
+*                   first when due and the record still fits, else after the
+*                   next SL_Poll: SL_CLOCK_MS leaves time before the us wrap
+*******************************************************************************/
+uint8_t SL_Put(const BLE_PduTypeDef *pdu)
+{
+    SL_RecordTypeDef *rec;
+
+    if((sl_count + 1 < SL_BATCH) && (TK_Get_Ms() - sl_mark_ms >= SL_CLOCK_MS)){
+        SL_Mark(SL_LEN_CLOCK);
+    }
+    if(sl_count >= SL_BATCH){
+        sl_drop++;
+        return 0;
+    }
+
+    rec = &sl_buf[sl_count++];
+    rec->us = pdu->time;
+    memcpy(rec->addr, pdu->addr, LEN_BLE_ADDR);
+    rec->type = pdu->hdr[0];
+    rec->len = pdu->len;
+    rec->rssi = pdu->rssi;
+    rec->ch = pdu->ch;
+    rec->hash = SL_Crc(pdu->data, pdu->len);
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Poll
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      write sl_buf once it holds a batch
+* Note:      :      main loop between adv events: the CPU stalls while flash
+*                   is busy, a sector erase takes ms
+*******************************************************************************/
+void SL_Poll(void)
+{
+    if(sl_count >= SL_BATCH) SL_Flush();
+}
+
+/*******************************************************************************
+* Function   :     	SL_Flush
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      write all records of sl_buf, moving on to the next sector
+*                   when the active one is full
+* Note:      :      see SL_Poll. a part batch costs a header word
+*******************************************************************************/
+void SL_Flush(void)
+{
+    uint8_t i = 0;
+    uint8_t n;
+    uint32_t end;
+
+    while(i < sl_count)
+    {
+        end = SL_SECTOR_ADDR(sl_active + 1);
+        n = (sl_free + 4 + SL_REC_SIZE <= end) ? (end - sl_free - 4)/SL_REC_SIZE : 0;
+        if(n == 0){
+            SL_Sector_Open((sl_active + 1) % SL_SECTORS, sl_seq + 1);
+            continue;
+        }
+
+        if(n > sl_count - i) n = sl_count - i;
+        SL_Write(&sl_buf[i], n);
+        i += n;
+    }
+    sl_count = 0;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Get_Drop
+* Parameter  :     	void
+* Returns    :     	uint16_t
+* Description:      records lost so far, SL_Poll not called in time
+* Note:      :
+*******************************************************************************/
+uint16_t SL_Get_Drop(void)
+{
+    return sl_drop;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Iter_Init
+* Parameter  :     	SL_IterTypeDef *it
+* Returns    :     	void
+* Description:      start at the oldest record in flash
+* Note:      :      records still in RAM are not seen, SL_Flush first.
+*                   no SL_Poll/SL_Flush while iterating
+*******************************************************************************/
+void SL_Iter_Init(SL_IterTypeDef *it)
+{
+    it->n = 0;
+    it->addr = 0;
+    it->end = 0;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Iter_Next
+* Parameter  :     	SL_IterTypeDef *it
+* Returns    :     	const SL_RecordTypeDef *, in flash. 0: no more
+* Description:      next record, oldest first
+* Note:      :      batches failing their CRC are skipped
+*******************************************************************************/
+const SL_RecordTypeDef *SL_Iter_Next(SL_IterTypeDef *it)
+{
+    uint8_t s;
+    uint32_t sec_end;
+    uint32_t next;
+    const SL_RecordTypeDef *rec;
+
+    while(it->addr >= it->end)
+    {
+        if(it->n >= SL_SECTORS) return 0;
+        s = (sl_active + 1 + it->n) % SL_SECTORS;   //oldest sector first
+        sec_end = SL_SECTOR_ADDR(s + 1);
+
+        if(it->addr == 0){  //entering sector s
+            if(!SL_Sector_Valid(s)){
+                it->n++;
+                continue;
+            }
+            it->end = SL_SECTOR_ADDR(s) + 4;
+        }
+
+        next = SL_Batch_End(it->end, sec_end);
+        if(next == 0){
+            it->n++;
+            it->addr = 0;
+            it->end = 0;
+            continue;
+        }
+
+        if(SL_HDR_CRC(SL_Word(it->end)) == SL_Crc((const uint8_t *)(it->end + 4), next - it->end - 4)){
+            it->addr = it->end + 4;
+        }else{
+            it->addr = next;
+        }
+        it->end = next;
+    }
+
+    rec = (const SL_RecordTypeDef *)it->addr;
+    it->addr += SL_REC_SIZE;
+    return rec;
+}
+
+/*******************************************************************************
+* Function   :     	SL_Dump
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      send every record to uart, oldest first, marks included
+* Note:      :      main loop between adv events, takes seconds. waits for the
+*                   uart on each record, PDUs received meanwhile may be dropped.
+*                   TRACE_ON: TR_ID_SCAN frames, else the raw records
+*******************************************************************************/
+void SL_Dump(void)
+{
+    SL_IterTypeDef it;
+    const SL_RecordTypeDef *rec;
+
+    SL_Flush();
+    SL_Iter_Init(&it);
+    while((rec = SL_Iter_Next(&it)) != 0)
+    {
+#if TRACE_ON
+        TRACE(TR_ID_SCAN, (const uint8_t *)rec, SL_REC_SIZE);
+#else
+        Uart_Put((const char *)rec, SL_REC_SIZE);
+#endif
+        Uart_Flush();
+    }
+}
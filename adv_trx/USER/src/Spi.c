@@ -11,18 +11,49 @@
 /* Includes ------------------------------------------------------------------*/
 #include "Includes.h"
 
+static uint8_t spi_bank = 0; //currently selected BLE register bank, 0: unknown
+
+//SPI_Async_* queue, filled by thread, drained by SPI0COMB_IRQHandler
+static SPI_XferTypeDef spi_queue[SPI_ASYNC_DEPTH];
+static volatile uint8_t spi_head = 0;  //transfer in progress
+static volatile uint8_t spi_tail = 0;  //next free slot
+static uint8_t spi_pos;                //bytes done of spi_queue[spi_head]
+static uint8_t spi_sel;                //bank select bytes left before it
+
+static void SPI_Async_Start(void);
+
+/*******************************************************************************
+* Function   :      SPI_Csn_Init
+* Parameter  :      void
+* Returns    :      void
+* Description:      BLE CSN pin, deasserted
+* Note:      :
+*******************************************************************************/
+void SPI_Csn_Init(void)
+{
+    GPIO_InitTypeDef GPIO_InitStruct;
+
+    GPIO_InitStruct.GPIO_Mode = GPIO_Mode_OUT;
+    GPIO_InitStruct.GPIO_OType = GPIO_OType_PP;
+    GPIO_InitStruct.GPIO_Pin = BLE_CSN_PIN;
+    GPIO_InitStruct.GPIO_PuPd = GPIO_PuPd_NOPULL;
+    GPIO_InitStruct.GPIO_Speed = GPIO_Speed_25MHz;
+    GPIO_Init(BLE_CSN_PORT, &GPIO_InitStruct);
+    GPIO_SetBits(BLE_CSN_PORT, BLE_CSN_PIN);
+}
+
 /*******************************************************************************
 * Function   :      SPI_Write_Byte
 * Parameter  :      uint8_t SendData
 * Returns    :      uint8_t
 * Description:
-* Note:      :
+* Note:      :      FastIo.h accessors, no call per register access
 *******************************************************************************/
 uint8_t SPI_Write_Byte(unsigned char SendData)
 {
-    SPI_SendData(SPI,SendData);
-    while(RESET == SPI_GetFlagStatus(SPI,SPI_FLAG_SPIF));
-    return SPI_ReceiveData(SPI);
+    FIO_Spi_Put(SendData);
+    while(!FIO_Spi_Done());
+    return FIO_Spi_Get();
 }
 
 #define SPI_Read_Byte()     SPI_Write_Byte(0xff)
@@ -37,6 +68,10 @@ uint8_t SPI_Write_Byte(unsigned char SendData)
 *******************************************************************************/
 void SPI_Write_Reg(uint8_t reg, uint8_t data) 
 { 
+    SPI_Async_Wait();
+
+    if(reg == BANK_SEL) spi_bank = data;
+
     BLE_CSN_CLR();
     
     SPI_Write_Byte(reg);
@@ -56,6 +91,8 @@ uint8_t SPI_Read_Reg(uint8_t reg)
 { 
     uint8_t temp0=0;
     
+    SPI_Async_Wait();
+
     BLE_CSN_CLR();
     
     SPI_Write_Byte(reg);
@@ -75,6 +112,8 @@ void SPI_Write_Buffer(uint8_t reg, uint8_t *dataBuf, uint8_t len)
 { 
     uint8_t temp0=0;
     
+    SPI_Async_Wait();
+
     BLE_CSN_CLR();
 
     SPI_Write_Byte(reg|0x20);
@@ -99,6 +138,8 @@ void SPI_Read_Buffer(uint8_t reg, uint8_t *dataBuf, uint8_t len)
 { 
     uint8_t temp0=0;
     
+    SPI_Async_Wait();
+
     BLE_CSN_CLR();
     
     SPI_Write_Byte(reg);
@@ -110,3 +151,205 @@ void SPI_Read_Buffer(uint8_t reg, uint8_t *dataBuf, uint8_t len)
 
     BLE_CSN_SET();
 }
+
+/*******************************************************************************
+* Function   :     	SPI_Write_Seq
+* Parameter  :     	const uint8_t *seq
+* Returns    :     	void
+* Description:      play back a register sequence, one CSN frame per entry
+* Note:      :      see SEQ_REG/SEQ_BUF/SEQ_END in Spi.h
+*******************************************************************************/
+void SPI_Write_Seq(const uint8_t *seq)
+{
+    uint8_t len;
+
+    SPI_Async_Wait();
+
+    while((len = *seq++) != SEQ_END)
+    {
+        if(*seq == BANK_SEL){
+            if(seq[1] == spi_bank){
+                seq += 2;
+                continue;
+            }
+            spi_bank = seq[1];
+        }
+
+        BLE_CSN_CLR();
+
+        SPI_Write_Byte(*seq++);
+        do{
+            SPI_Write_Byte(*seq++);
+        }while(--len);
+
+        BLE_CSN_SET();
+    }
+}
+
+/*******************************************************************************
+* Function   :     	SPI_Select_Bank
+* Parameter  :     	uint8_t bank
+* Returns    :     	void
+* Description:      select BLE register bank, skipped if already selected
+* Note:      :      BANK_51/BANK_53/BANK_56
+*******************************************************************************/
+void SPI_Select_Bank(uint8_t bank)
+{
+    if(bank != spi_bank){
+        SPI_Write_Reg(BANK_SEL, bank);
+    }
+}
+
+/*******************************************************************************
+* Function   :     	SPI_Reset_Bank
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      forget the selected bank, next select is always written
+* Note:      :      call when BLE may have been reset
+*******************************************************************************/
+void SPI_Reset_Bank(void)
+{
+    spi_bank = 0;
+}
+
+/*******************************************************************************
+* Function   :     	SPI_Async_Submit
+* Parameter  :     	const SPI_XferTypeDef *xfer
+* Returns    :     	uint8_t, 1: queued, 0: queue full
+* Description:      queue a transfer, returns at once
+* Note:      :      xfer is copied, xfer->buf is not. spi_bank is the bank once
+*                   the queue has run, the blocking functions wait for it
+*******************************************************************************/
+uint8_t SPI_Async_Submit(const SPI_XferTypeDef *xfer)
+{
+    uint8_t next = (spi_tail + 1) % SPI_ASYNC_DEPTH;
+
+    if(next == spi_head) return 0;
+
+    spi_queue[spi_tail] = *xfer;
+    if(xfer->bank == spi_bank){
+        spi_queue[spi_tail].bank = 0;   //selected already
+    }else if(xfer->bank){
+        spi_bank = xfer->bank;
+    }
+
+    NVIC_DisableIRQ(SPI0COMB_IRQn);
+    if(spi_head == spi_tail){ //idle, start now
+        spi_tail = next;
+        NVIC_ClearPendingIRQ(SPI0COMB_IRQn); //left over from blocking transfers
+        SPI_Async_Start();
+    }else{
+        spi_tail = next;
+    }
+    NVIC_EnableIRQ(SPI0COMB_IRQn);
+
+    return 1;
+}
+
+/*******************************************************************************
+* Function   :     	SPI_Async_Busy
+* Parameter  :     	void
+* Returns    :     	uint8_t, 1: transfers pending
+* Description:
+* Note:      :
+*******************************************************************************/
+uint8_t SPI_Async_Busy(void)
+{
+    return (spi_head != spi_tail);
+}
+
+/*******************************************************************************
+* Function   :     	SPI_Async_Wait
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      sleep until all queued transfers are done
+* Note:      :      SPI0COMB_IRQn must preempt the caller
+*******************************************************************************/
+void SPI_Async_Wait(void)
+{
+    while(spi_head != spi_tail)
+    {
+        __disable_irq();
+        if(spi_head != spi_tail){
+            SCB->SCR &= (~0x04);
+            __WFI();
+        }
+        __enable_irq();
+    }
+}
+
+/*******************************************************************************
+* Function   :     	SPI_Async_Start
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      select BLE and send the command byte of spi_queue[spi_head],
+*                   or its bank select frame first
+* Note:      :
+*******************************************************************************/
+static void SPI_Async_Start(void)
+{
+    SPI_XferTypeDef *xfer = &spi_queue[spi_head];
+
+    spi_pos = 0;
+
+    BLE_CSN_CLR();
+    if(xfer->bank){
+        spi_sel = 2;
+        FIO_Spi_Put(BANK_SEL);
+    }else if(xfer->dir == SPI_DIR_WRITE){
+        FIO_Spi_Put(xfer->reg|0x20);
+    }else{
+        FIO_Spi_Put(xfer->reg);
+    }
+}
+
+/*******************************************************************************
+* Function   :     	SPI0COMB_IRQHandler
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      one byte done: store it, send the next or finish the transfer
+* Note:      :      SPIF is cleared by reading STAT then DATA
+*******************************************************************************/
+void SPI0COMB_IRQHandler(void)
+{
+    SPI_XferTypeDef *xfer = &spi_queue[spi_head];
+    uint8_t data;
+
+    if(!FIO_Spi_Done()) return;
+    data = FIO_Spi_Get();
+
+    if(spi_sel){ //bank select frame: BANK_SEL, bank
+        if(--spi_sel){
+            FIO_Spi_Put(xfer->bank);
+        }else{
+            BLE_CSN_SET();
+            BLE_CSN_CLR();
+            FIO_Spi_Put((xfer->dir == SPI_DIR_WRITE) ? (xfer->reg|0x20) : xfer->reg);
+        }
+        return;
+    }
+
+    if((xfer->dir == SPI_DIR_READ) && (spi_pos > 0)){
+        xfer->buf[spi_pos-1] = data;
+    }
+
+    if(spi_pos < xfer->len){
+        spi_pos++;
+        if(xfer->dir == SPI_DIR_WRITE){
+            FIO_Spi_Put(xfer->buf[spi_pos-1]);
+        }else{
+            FIO_Spi_Put(0xff);
+        }
+        return;
+    }
+
+    BLE_CSN_SET();
+    if(xfer->done) xfer->done();
+
+    spi_head = (spi_head + 1) % SPI_ASYNC_DEPTH;
+    if(spi_head != spi_tail){
+        SPI_Async_Start();
+    }else{
+        NVIC_DisableIRQ(SPI0COMB_IRQn);
+    }
+}
@@ -0,0 +1,260 @@
+/**
+  ******************************************************************************
+  * @file    :Tickless.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :LPTIMER one-shot deadlines, replaces the 1ms SysTick
+  ******************************************************************************
+***/
+
+/* Includes ------------------------------------------------------------------*/
+#include "Includes.h"
+
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+    uint8_t run;
+    uint32_t due;               //tk_ticks at expiry
+    void (*expire)(void);       //called from LPTIMER_IRQHandler, may be 0
+}TK_SlotTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static TK_SlotTypeDef tk_slot[TK_ID_MAX];
+static volatile uint32_t tk_ticks = 0;  //LPTIMER ticks up to the last reload
+static volatile uint32_t tk_ms = 0;     //same in ms
+static volatile uint32_t tk_frac = 0;   //ms*TK_CLK_HZ remainder of tk_ms
+static volatile uint32_t tk_load;       //counts up from here, IRQ at 0xFFFF
+
+
+/*******************************************************************************
+* Function   :     	TK_Fold
+* Parameter  :     	uint32_t ticks, elapsed since tk_ticks
+* Returns    :     	void
+* Description:      move tk_ticks/tk_ms on
+* Note:      :      irq off
+*******************************************************************************/
+static void TK_Fold(uint32_t ticks)
+{
+    tk_ticks += ticks;
+    tk_frac += ticks * 1000;
+    tk_ms += tk_frac / TK_CLK_HZ;
+    tk_frac %= TK_CLK_HZ;
+}
+
+/*******************************************************************************
+* Function   :     	TK_Count
+* Parameter  :     	void
+* Returns    :     	uint32_t, LPTIMER ticks since tk_ticks
+* Description:      fold a reload LPTIMER_IRQHandler has not served yet, then
+*                   read the count of the running period, not folded
+* Note:      :      irq off. the IRQ stays pending, it expires the deadlines.
+*                   GPIOB_IRQHandler preempts LPTIMER_IRQHandler
+*******************************************************************************/
+static uint32_t TK_Count(void)
+{
+    uint32_t cnt = LPTIMER_ReadCnt();
+
+    if(LPTIMER_GetITStatus(LPTIMER, LPTIMER_IT_FLAG)){
+        LPTIMER_ClearITFlag(LPTIMER, LPTIMER_IT_FLAG);
+        NVIC_SetPendingIRQ(LPTIMER_IRQn);
+        //counter reloaded to tk_load and runs on, fold the finished period
+        TK_Fold(TK_PERIOD_MAX + 1 - tk_load);
+        cnt = LPTIMER_ReadCnt();    //the first read may be before the reload
+    }
+    return (cnt - tk_load) & TK_PERIOD_MAX;
+}
+
+/*******************************************************************************
+* Function   :     	TK_Program
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      restart LPTIMER, one period to the nearest deadline
+* Note:      :      irq off
+*******************************************************************************/
+static void TK_Program(void)
+{
+    uint8_t i;
+    int32_t left;
+    uint32_t period = TK_PERIOD_MAX;
+
+    LPTIMER_Cmd(LPTIMER, DISABLE);
+    TK_Fold(TK_Count());
+
+    for(i=0; i<TK_ID_MAX; i++){
+        if(!tk_slot[i].run) continue;
+        left = (int32_t)(tk_slot[i].due - tk_ticks);
+        if(left < 1) left = 1;
+        if((uint32_t)left < period) period = left;
+    }
+
+    tk_load = TK_PERIOD_MAX + 1 - period;
+    LPTIMER_LoadConfig(LPTIMER, tk_load);
+    LPTIMER_BGloadConfig(LPTIMER, tk_load);
+    LPTIMER_Cmd(LPTIMER, ENABLE);
+}
+
+/*******************************************************************************
+* Function   :     	TK_Init
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      LPTIMER on LIRC, auto reload, interrupt
+* Note:      :      LIRC on, see SysClock_Init
+*******************************************************************************/
+void TK_Init(void)
+{
+    LPTIMER_InitTypeDef LPTIMER_InitStruct;
+
+    RCC->APBCLKEN |= RCC_APBPeriph_LPTIMCKEN;
+
+    LPTIMER_InitStruct.LPTIMER_Mode = LPTIMER_MODE2;
+    LPTIMER_InitStruct.LPTIMER_CTEN = LPTIMER_TIMER;
+    LPTIMER_InitStruct.LPTIMER_TCLK = LPTIMER_TCLK_LIRC;
+    LPTIMER_InitStruct.LPTIMER_GATEEN = LPTIMER_NGATE;
+    LPTIMER_InitStruct.LPTIMER_GATEPOLE = LPTIMER_GATE_HIGH;
+    LPTIMER_InitStruct.LPTIMER_TCLKCUTEN = LPTIMER_TICK_CUTDISABLE;
+    LPTIMER_Init(LPTIMER, &LPTIMER_InitStruct);
+
+    tk_load = 0;
+    LPTIMER_LoadConfig(LPTIMER, tk_load);
+    LPTIMER_ClearITFlag(LPTIMER, LPTIMER_IT_FLAG);
+    LPTIMER_ITConfig(LPTIMER, ENABLE);
+
+    NVIC_SetPriority(LPTIMER_IRQn,3);
+    NVIC_EnableIRQ(LPTIMER_IRQn);
+
+    __disable_irq();
+    TK_Program();
+    __enable_irq();
+}
+
+/*******************************************************************************
+* Function   :     	TK_Start
+* Parameter  :     	uint8_t id, uint32_t ms, void (*expire)(void)
+* Returns    :     	void
+* Description:      (re)arm deadline id, ms from now
+* Note:      :      rounded up to the next LIRC tick
+*******************************************************************************/
+void TK_Start(uint8_t id, uint32_t ms, void (*expire)(void))
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    tk_slot[id].due = tk_ticks + TK_Count() + ms * (TK_CLK_HZ/100) / 10 + 1;
+    tk_slot[id].expire = expire;
+    tk_slot[id].run = 1;
+    TK_Program();
+    __set_PRIMASK(primask);
+}
+
+/*******************************************************************************
+* Function   :     	TK_Stop
+* Parameter  :     	uint8_t id
+* Returns    :     	void
+* Description:      cancel deadline id, expire is not called
+* Note:      :      LPTIMER keeps its period, next reload drops to TK_PERIOD_MAX
+*******************************************************************************/
+void TK_Stop(uint8_t id)
+{
+    tk_slot[id].run = 0;
+}
+
+/*******************************************************************************
+* Function   :     	TK_Running
+* Parameter  :     	uint8_t id
+* Returns    :     	uint8_t, 1: armed and not expired yet
+* Description:
+* Note:      :
+*******************************************************************************/
+uint8_t TK_Running(uint8_t id)
+{
+    return tk_slot[id].run;
+}
+
+/*******************************************************************************
+* Function   :     	TK_Sleep_Until
+* Parameter  :     	uint8_t id
+* Returns    :     	void
+* Description:      sleep until deadline id expires
+* Note:      :      other interrupts are served on the way
+*******************************************************************************/
+void TK_Sleep_Until(uint8_t id)
+{
+    while(tk_slot[id].run)
+    {
+        __disable_irq();
+        if(tk_slot[id].run){
+            SCB->SCR &= (~0x04);
+            __WFI();
+        }
+        __enable_irq();
+    }
+}
+
+/*******************************************************************************
+* Function   :     	TK_Get_Ms
+* Parameter  :     	void
+* Returns    :     	uint32_t
+* Description:      ms since TK_Init
+* Note:      :      counts in deep sleep too
+*******************************************************************************/
+uint32_t TK_Get_Ms(void)
+{
+    uint32_t ms;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    ms = TK_Count();
+    ms = tk_ms + (tk_frac + ms * 1000) / TK_CLK_HZ;
+    __set_PRIMASK(primask);
+    return ms;
+}
+
+/*******************************************************************************
+* Function   :     	TK_Get_Ticks
+* Parameter  :     	void
+* Returns    :     	uint32_t, TK_CLK_HZ ticks
+* Description:      ticks since TK_Init, wraps after 31h
+* Note:      :      no SPI, for stamps while the BLE is powered down
+*******************************************************************************/
+uint32_t TK_Get_Ticks(void)
+{
+    uint32_t ticks;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    ticks = tk_ticks + TK_Count();
+    __set_PRIMASK(primask);
+    return ticks;
+}
+
+/*******************************************************************************
+* Function   :     	LPTIMER_IRQHandler
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      period over: expire due deadlines, program the next one
+* Note:      :
+*******************************************************************************/
+void LPTIMER_IRQHandler(void)
+{
+    uint8_t i;
+    uint32_t now;
+    void (*expire[TK_ID_MAX])(void);
+
+    __disable_irq();
+    now = tk_ticks + TK_Count();    //folds the reload, unless already taken
+    for(i=0; i<TK_ID_MAX; i++){
+        expire[i] = 0;
+        if(tk_slot[i].run && ((int32_t)(tk_slot[i].due - now) <= 0)){
+            tk_slot[i].run = 0;
+            expire[i] = tk_slot[i].expire;
+        }
+    }
+    TK_Program();
+    __enable_irq();
+
+    for(i=0; i<TK_ID_MAX; i++){
+        if(expire[i]) expire[i]();
+    }
+}
@@ -0,0 +1,189 @@
+/**
+  ******************************************************************************
+  * @file    :Timebase.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :us timebase, BLE CLK_CNT LF/HF counters + LPTIMER
+  ******************************************************************************
+***/
+
+/* Includes ------------------------------------------------------------------*/
+#include "Includes.h"
+
+
+/* Private define ------------------------------------------------------------*/
+//1000000/TK_CLK_HZ as a fraction
+#if (TK_CLK_HZ != 38400UL)
+#error "TB_TK_MUL/TB_TK_DIV are for a 38.4kHz LPTIMER"
+#endif
+#define TB_TK_MUL           625
+#define TB_TK_DIV           24
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t tb_sync = 0;     //anchors below are valid
+static uint8_t tb_radio = 0;    //BLE powered up, CLK_CNT runs
+static uint8_t tb_lf_ok = 0;    //tb_lf read from this power up
+static uint32_t tb_tk;          //TK_Get_Ticks() at last sample
+static uint32_t tb_lf;          //LF counter at last sample
+static uint32_t tb_ticks;       //LF ticks not yet in tb_us, < LFCLK_1MS
+static uint32_t tb_tk_frac;     //us*TB_TK_DIV not yet in tb_us
+static uint32_t tb_us;
+
+
+/*******************************************************************************
+* Function   :     	TB_Lock
+* Parameter  :     	void
+* Returns    :     	uint32_t, GPIOB_IRQn enable bit to restore
+* Description:      keep GPIOB_IRQHandler off the SPI and the anchors
+* Note:      :      nests with callers that already masked it
+*******************************************************************************/
+static uint32_t TB_Lock(void)
+{
+    uint32_t en = NVIC->ISER[0] & (1UL << GPIOB_IRQn);
+
+    NVIC_DisableIRQ(GPIOB_IRQn);
+    return en;
+}
+
+static void TB_Unlock(uint32_t en)
+{
+    if(en) NVIC_EnableIRQ(GPIOB_IRQn);
+}
+
+/*******************************************************************************
+* Function   :     	TB_Read_Clk
+* Parameter  :     	uint32_t *hf, 0: not wanted
+* Returns    :     	uint32_t, LF counter
+* Description:      read CLK_CNT, 23:0 HF counter, 47:24 LF counter
+* Note:      :      one read, both counters from the same instant. the LF bytes
+*                   follow the HF ones, they cannot be read alone.
+*                   no bank write if BANK_56 is selected already
+*******************************************************************************/
+static uint32_t TB_Read_Clk(uint32_t *hf)
+{
+    uint8_t temp0[6];
+
+    SPI_Select_Bank(BANK_56);
+    SPI_Read_Buffer(CLK_CNT, temp0, 6);
+
+    if(hf) *hf = temp0[0] | ((uint32_t)temp0[1] << 8) | ((uint32_t)temp0[2] << 16);
+    return temp0[3] | ((uint32_t)temp0[4] << 8) | ((uint32_t)temp0[5] << 16);
+}
+
+/*******************************************************************************
+* Function   :     	TB_Sample
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      move tb_us up to now
+* Note:      :      LF ticks when the BLE counted the whole gap, else LPTIMER
+*                   ticks (26us). one SPI read with the BLE powered up
+*******************************************************************************/
+static void TB_Sample(void)
+{
+    uint32_t tk;
+    uint32_t lf = 0;
+    uint32_t ticks;
+    uint32_t ms;
+
+    tk = TK_Get_Ticks();
+    if(tb_radio) lf = TB_Read_Clk(0);
+
+    if(tb_sync){
+        tk -= tb_tk;    //elapsed
+        if(tb_radio && tb_lf_ok){
+            ticks = (lf - tb_lf) & TB_CNT_MASK;
+            //the LF counter wraps every TB_LF_WRAP_MS, the LPTIMER counts them
+            while(tk/(TK_CLK_HZ/100)*10 > (ticks/LFCLK_1MS + TB_LF_WRAP_MS/2)){
+                ticks += TB_CNT_MASK + 1;
+            }
+            tb_ticks += ticks;
+            ms = tb_ticks / LFCLK_1MS;
+            tb_ticks -= ms * LFCLK_1MS;
+            tb_us += ms * 1000;
+        }else{
+            tb_us += tb_ticks * 1000 / LFCLK_1MS;
+            tb_ticks = 0;
+            tb_tk_frac += (tk % TB_TK_DIV) * TB_TK_MUL;
+            tb_us += (tk / TB_TK_DIV) * TB_TK_MUL + tb_tk_frac / TB_TK_DIV;
+            tb_tk_frac %= TB_TK_DIV;
+        }
+        tk += tb_tk;
+    }
+
+    tb_sync = 1;
+    tb_tk = tk;
+    tb_lf = lf;
+    tb_lf_ok = tb_radio;
+}
+
+/*******************************************************************************
+* Function   :     	TB_Radio_On
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      BLE powered up, CLK_CNT counts from here
+* Note:      :      called by BLE_Mode_PwrUp
+*******************************************************************************/
+void TB_Radio_On(void)
+{
+    uint32_t en = TB_Lock();
+
+    TB_Sample();        //gap in LPTIMER ticks
+    tb_radio = 1;
+    tb_lf = TB_Read_Clk(0);
+    tb_lf_ok = 1;
+    TB_Unlock(en);
+}
+
+/*******************************************************************************
+* Function   :     	TB_Radio_Off
+* Parameter  :     	void
+* Returns    :     	void
+* Description:      BLE about to power down, CLK_CNT no longer usable
+* Note:      :      called by BLE_Mode_PwrDn
+*******************************************************************************/
+void TB_Radio_Off(void)
+{
+    uint32_t en = TB_Lock();
+
+    TB_Sample();
+    tb_radio = 0;
+    tb_lf_ok = 0;
+    TB_Unlock(en);
+}
+
+/*******************************************************************************
+* Function   :     	TB_Get_Us
+* Parameter  :     	void
+* Returns    :     	uint32_t, us
+* Description:      monotonic timestamp, wraps after 71 min
+* Note:      :      31.25us steps while the BLE is powered up, 26us while not.
+*                   one CLK_CNT read, see TB_Read_Clk
+*******************************************************************************/
+uint32_t TB_Get_Us(void)
+{
+    uint32_t us;
+    uint32_t en = TB_Lock();
+
+    TB_Sample();
+    us = tb_us + tb_ticks * 1000 / LFCLK_1MS;
+    TB_Unlock(en);
+    return us;
+}
+
+/*******************************************************************************
+* Function   :     	TB_Get_Hf
+* Parameter  :     	void
+* Returns    :     	uint32_t, HF counter, HFCLK_1MS
+* Description:      sub-us stamps inside one BLE wakeup
+* Note:      :      HF runs while the BLE is awake only. ((b - a) & TB_CNT_MASK)
+*******************************************************************************/
+uint32_t TB_Get_Hf(void)
+{
+    uint32_t hf = 0;
+    uint32_t en = TB_Lock();
+
+    if(tb_radio) TB_Read_Clk(&hf);
+    TB_Unlock(en);
+    return hf;
+}
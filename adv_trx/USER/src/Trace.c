@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file    :Trace.c
+  * @author  :MG Team
+  * @version :V1.0
+  * @date
+  * @brief   :binary event trace, COBS framed on the UART
+  ******************************************************************************
+***/
+
+/* Includes ------------------------------------------------------------------*/
+#include "Includes.h"
+
+
+/* Private define ------------------------------------------------------------*/
+#define TR_RAW_MAX          (3 + TR_ARG_MAX)        //id, ms[2], arg
+#define TR_FRAME_MAX        (1 + TR_RAW_MAX + 1)    //COBS code, raw, 0x00
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t tr_drop = 0;    //Uart_Get_Drop() last traced
+
+/*******************************************************************************
+* Function   :     	TR_Le32
+* Parameter  :     	uint8_t *p, uint32_t v
+* Returns    :     	void
+* Description:      v to p[0..3], little endian
+* Note:      :
+*******************************************************************************/
+static void TR_Le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/*******************************************************************************
+* Function   :     	TR_Frame
+* Parameter  :     	uint8_t id, const uint8_t *arg, uint8_t len
+* Returns    :     	void
+* Description:      COBS encode {id, ms, arg} and queue it with its 0x00
+* Note:      :      len <= TR_ARG_MAX, so one COBS block
+*******************************************************************************/
+static void TR_Frame(uint8_t id, const uint8_t *arg, uint8_t len)
+{
+    uint8_t frame[TR_FRAME_MAX];
+    uint8_t raw[3];
+    uint16_t ms = (uint16_t)TK_Get_Ms();
+    uint8_t code = 0;   //frame[] index of the current COBS code byte
+    uint8_t pos = 1;
+    uint8_t i;
+    uint8_t c;
+
+    raw[0] = id;
+    raw[1] = (uint8_t)ms;
+    raw[2] = (uint8_t)(ms >> 8);
+
+    for(i = 0; i < (3 + len); i++){
+        c = (i < 3) ? raw[i] : arg[i - 3];
+        if(c == 0){
+            frame[code] = pos - code;
+            code = pos++;
+        }else{
+            frame[pos++] = c;
+        }
+    }
+    frame[code] = pos - code;
+    frame[pos++] = 0x00;
+
+    Uart_Put((const char *)frame, pos);
+}
+
+/*******************************************************************************
+* Function   :     	TR_Put
+* Parameter  :     	uint8_t id, const uint8_t *arg, uint8_t len
+* Returns    :     	void
+* Description:      trace one event, returns at once
+* Note:      :      thread and interrupts. args over TR_ARG_MAX are cut.
+*                   new UART drops are traced first, TR_ID_UART_DROP
+*******************************************************************************/
+void TR_Put(uint8_t id, const uint8_t *arg, uint8_t len)
+{
+    uint32_t drop = Uart_Get_Drop();
+    uint8_t buf[4];
+
+    if(drop != tr_drop){
+        tr_drop = drop;
+        TR_Le32(buf, drop);
+        TR_Frame(TR_ID_UART_DROP, buf, 4);
+    }
+
+    if(len > TR_ARG_MAX) len = TR_ARG_MAX;
+    TR_Frame(id, arg, len);
+}
+
+/*******************************************************************************
+* Function   :     	TR_Put_U32
+* Parameter  :     	uint8_t id, uint32_t a, uint32_t b
+* Returns    :     	void
+* Description:      trace an event with two u32 args
+* Note:      :
+*******************************************************************************/
+void TR_Put_U32(uint8_t id, uint32_t a, uint32_t b)
+{
+    uint8_t buf[8];
+
+    TR_Le32(&buf[0], a);
+    TR_Le32(&buf[4], b);
+    TR_Put(id, buf, 8);
+}
@@ -5,11 +5,13 @@ uint8_t txcnt = 0;
 uint8_t rxcnt = 0;
 
 extern void Key_Scan(void);
-extern uint8_t ble_McuCanSleep(void);
 
 
 static void Enter_DeepSleep(void)
 {
+#ifndef UART_TX_DEEPSLEEP
+    Uart_Flush(); //UART0 stops in deep sleep
+#endif
     SCB->SCR |= 0x04;
     __WFI();
 }
@@ -17,6 +19,10 @@ static void Enter_DeepSleep(void)
 
 int main( void )
 {
+    BLE_PduTypeDef *pdu;
+    uint16_t interval;
+    uint8_t cmd;
+
     BSP_Init();
     
     //BLE initnal
@@ -25,12 +31,31 @@ int main( void )
     //////ble rtx api
     txcnt=3; //txcnt=0 is for rx only application
     rxcnt=6; //rxcnt=0 is for tx only application
+    interval=BLE_ADV_INTERVAL;
+    KV_Get(KV_KEY_TXCNT, &txcnt, 1); //stored overrides, see Kv.h
+    KV_Get(KV_KEY_RXCNT, &rxcnt, 1);
+    KV_Get(KV_KEY_ADV_INTERVAL, &interval, 2);
+    BLE_Set_Interval(interval); //BLE wakes itself for each adv event
     BLE_Start();
     
     while(1)
     {
-        if (ble_McuCanSleep()){
-            Enter_DeepSleep(); //active by RTC
+        //////rx pdu, queued by GPIOB_IRQHandler
+        while((pdu = RxQ_Front()) != 0){
+#ifdef BLE_RXDEBUG
+            BLE_Dump_Pdu(pdu);
+#endif
+            SL_Put(pdu);
+            RxQ_Pop();
+        }
+
+        if (ble_McuCanSleep() && (RxQ_Count() == 0)){
+            SL_Poll(); //flash stalls the CPU, between adv events only
+            if(Uart_Get(&cmd) && (cmd == SL_CMD_DUMP)){
+                SL_Dump();
+                continue;
+            }
+            Enter_DeepSleep(); //active by BLE IRQ
         }
         //////user proc
         Key_Scan();
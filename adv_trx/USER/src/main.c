@@ -7,6 +7,9 @@ uint8_t rxcnt = 0;
 
 static void Enter_DeepSleep(void)
 {
+#ifndef UART_TX_DEEPSLEEP
+    Uart_Flush(); //UART0 stops in deep sleep
+#endif
     SCB->SCR |= 0x04;
     __WFI();
 }
@@ -19,6 +22,8 @@ static void Enter_Sleep(void)
 
 int main( void )
 {
+    BLE_PduTypeDef *pdu;
+
     BSP_Init();
     
     //BLE initnal
@@ -35,6 +40,14 @@ int main( void )
         rxcnt=0; //rxcnt=0 is for tx only application
         BLE_TRX();
 
+        //////rx pdu, queued by GPIOB_IRQHandler
+        while((pdu = RxQ_Front()) != 0){
+            BLE_Dump_Pdu(pdu); //debug
+            SL_Put(pdu);
+            RxQ_Pop();
+        }
+        SL_Poll(); //BLE_TRX done, radio idle
+
         Enter_DeepSleep(); //active by RTC
     }
 